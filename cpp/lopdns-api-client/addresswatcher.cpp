@@ -0,0 +1,221 @@
+#include "nlohmann/json.hpp"
+#include "logging.h"
+
+#include "addresswatcher.h"
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_addr.h>
+
+using json = nlohmann::json;
+
+constexpr size_t netlinkBufferSize = 16384;
+
+AddressWatcher::AddressWatcher(const std::string& interfaceName, int family)
+{
+    this->interfaceName = interfaceName;
+    this->family = family;
+}
+
+AddressWatcher::~AddressWatcher()
+{
+    if (socketFd >= 0) {
+        close(socketFd);
+    }
+}
+
+bool AddressWatcher::open()
+{
+    interfaceIndex = if_nametoindex(interfaceName.c_str());
+    if (interfaceIndex == 0) {
+        LOG_ERROR << "Unknown network interface: " << interfaceName;
+        return false;
+    }
+    socketFd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (socketFd < 0) {
+        LOG_ERROR << "Failed to open netlink socket: " << strerror(errno);
+        return false;
+    }
+    sockaddr_nl address = {};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = family == AF_INET6 ? RTMGRP_IPV6_IFADDR : RTMGRP_IPV4_IFADDR;
+    if (bind(socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        LOG_ERROR << "Failed to subscribe to address changes: " << strerror(errno);
+        close(socketFd);
+        socketFd = -1;
+        return false;
+    }
+    LOG_DEBUG << "Watching addresses of " << interfaceName << " (index " << interfaceIndex << ").";
+    return true;
+}
+
+std::vector<std::string> AddressWatcher::addresses()
+{
+    std::vector<std::string> result;
+    // Dumps use their own socket so that their replies do not mix with the notifications
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        LOG_ERROR << "Failed to open netlink socket: " << strerror(errno);
+        return result;
+    }
+
+    struct
+    {
+        nlmsghdr header;
+        ifaddrmsg message;
+    } request = {};
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(ifaddrmsg));
+    request.header.nlmsg_type = RTM_GETADDR;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = 1;
+    request.message.ifa_family = static_cast<unsigned char>(family);
+    if (send(fd, &request, request.header.nlmsg_len, 0) < 0) {
+        LOG_ERROR << "Failed to request the interface addresses: " << strerror(errno);
+        close(fd);
+        return result;
+    }
+
+    std::vector<char> buffer(netlinkBufferSize);
+    bool done = false;
+    while (!done) {
+        ssize_t length = recv(fd, buffer.data(), buffer.size(), 0);
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR << "Failed to read the interface addresses: " << strerror(errno);
+            break;
+        }
+        for (nlmsghdr* header = reinterpret_cast<nlmsghdr*>(buffer.data()); NLMSG_OK(header, size_t(length));
+             header = NLMSG_NEXT(header, length)) {
+            if (header->nlmsg_type == NLMSG_DONE || header->nlmsg_type == NLMSG_ERROR) {
+                done = true;
+                break;
+            }
+            if (header->nlmsg_type != RTM_NEWADDR) {
+                continue;
+            }
+            const ifaddrmsg* message = static_cast<const ifaddrmsg*>(NLMSG_DATA(header));
+            if (message->ifa_index != interfaceIndex || message->ifa_family != family
+                || message->ifa_scope != RT_SCOPE_UNIVERSE) {
+                continue;
+            }
+
+            uint32_t flags = message->ifa_flags;
+            const void* address = nullptr;
+            const void* local = nullptr;
+            int attributeLength = IFA_PAYLOAD(header);
+            for (const rtattr* attribute = IFA_RTA(message); RTA_OK(attribute, attributeLength);
+                 attribute = RTA_NEXT(attribute, attributeLength)) {
+                if (attribute->rta_type == IFA_ADDRESS) {
+                    address = RTA_DATA(attribute);
+                } else if (attribute->rta_type == IFA_LOCAL) {
+                    local = RTA_DATA(attribute);
+                } else if (attribute->rta_type == IFA_FLAGS) {
+                    std::memcpy(&flags, RTA_DATA(attribute), sizeof(flags));
+                }
+            }
+            if (flags & (IFA_F_DEPRECATED | IFA_F_TENTATIVE | IFA_F_TEMPORARY | IFA_F_DADFAILED)) {
+                continue;
+            }
+            // On point-to-point links IFA_ADDRESS is the peer, IFA_LOCAL the own address
+            const void* own = local != nullptr ? local : address;
+            char text[INET6_ADDRSTRLEN];
+            if (own != nullptr && inet_ntop(family, own, text, sizeof(text)) != nullptr) {
+                result.push_back(text);
+            }
+        }
+    }
+    close(fd);
+    return result;
+}
+
+bool AddressWatcher::waitForChange(std::chrono::milliseconds timeout)
+{
+    pollfd descriptor = {socketFd, POLLIN, 0};
+    int ready = poll(&descriptor, 1, int(timeout.count()));
+    if (ready <= 0) {
+        return false;
+    }
+
+    // Drain all pending notifications, several usually arrive for one change
+    bool changed = false;
+    std::vector<char> buffer(netlinkBufferSize);
+    for (;;) {
+        ssize_t length = recv(socketFd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+        if (length < 0) {
+            if (errno == ENOBUFS) {
+                // Notifications were dropped, treat it as a change and read the addresses again
+                changed = true;
+                continue;
+            }
+            break;
+        }
+        for (nlmsghdr* header = reinterpret_cast<nlmsghdr*>(buffer.data()); NLMSG_OK(header, size_t(length));
+             header = NLMSG_NEXT(header, length)) {
+            if (header->nlmsg_type != RTM_NEWADDR && header->nlmsg_type != RTM_DELADDR) {
+                continue;
+            }
+            const ifaddrmsg* message = static_cast<const ifaddrmsg*>(NLMSG_DATA(header));
+            if (message->ifa_index == interfaceIndex && message->ifa_family == family) {
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+bool loadPublishedAddresses(const std::string& path, PublishedAddresses& published)
+{
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    try
+    {
+        json data = json::parse(file);
+        for (const auto& item : data.items()) {
+            if (item.value().is_string()) {
+                published[item.key()] = item.value().get<std::string>();
+            }
+        }
+    }
+    catch (const json::exception& e)
+    {
+        LOG_WARNING << "Ignoring invalid state file " << path << ": " << e.what();
+        return false;
+    }
+    return true;
+}
+
+bool savePublishedAddresses(const std::string& path, const PublishedAddresses& published)
+{
+    json data = json::object();
+    for (const auto& entry : published) {
+        data[entry.first] = entry.second;
+    }
+
+    // Replace the file atomically so that a crash never leaves a partial state behind
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::trunc);
+        if (!file || !(file << data.dump(2) << "\n")) {
+            LOG_ERROR << "Failed to write state file " << temporaryPath;
+            return false;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        LOG_ERROR << "Failed to replace state file " << path;
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
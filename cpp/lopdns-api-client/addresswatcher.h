@@ -0,0 +1,47 @@
+#ifndef ADDRESSWATCHER_H
+#define ADDRESSWATCHER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <sys/socket.h>
+
+// Watches the addresses of a network interface through rtnetlink. The kernel notifies the
+// socket with RTM_NEWADDR and RTM_DELADDR, so nothing is polled while the addresses stay
+// the same.
+class AddressWatcher
+{
+public:
+    // family is AF_INET or AF_INET6
+    AddressWatcher(const std::string& interfaceName, int family);
+    ~AddressWatcher();
+
+    AddressWatcher(const AddressWatcher&) = delete;
+    AddressWatcher& operator=(const AddressWatcher&) = delete;
+
+    // Subscribes to the address notifications, false if the interface or the socket is not available
+    bool open();
+
+    // Global addresses of the interface in kernel order. Link-local, deprecated, tentative and
+    // temporary (privacy) addresses are left out, they should not be published.
+    std::vector<std::string> addresses();
+
+    // Waits until an address of the interface was added or removed, false on timeout
+    bool waitForChange(std::chrono::milliseconds timeout);
+
+private:
+    std::string interfaceName;
+    int family;
+    unsigned int interfaceIndex = 0;
+    int socketFd = -1;
+};
+
+// The content last published per record, keyed by "zone/name/type", kept between runs so that
+// a restart does not update records that are still current
+typedef std::map<std::string, std::string> PublishedAddresses;
+
+bool loadPublishedAddresses(const std::string& path, PublishedAddresses& published);
+bool savePublishedAddresses(const std::string& path, const PublishedAddresses& published);
+
+#endif // ADDRESSWATCHER_H
@@ -0,0 +1,351 @@
+#include "nlohmann/json.hpp"
+#include "logging.h"
+
+#include "apisimulation.h"
+#include <ctime>
+#include <chrono>
+#include <thread>
+#include <cctype>
+#include <algorithm>
+
+using json = nlohmann::json;
+
+const std::string SIMULATION_ENCODING = "application/json";
+const std::string SIMULATION_PREFIX = "/v2";
+const char* SIMULATION_RECORD_TYPES[] = {"A", "AAAA", "CNAME", "MX", "TXT"};
+
+static Response makeResponse(int code, const std::string& body)
+{
+    Response response;
+    response.code = code;
+    response.body = body;
+    response.headers["Content-Type"] = SIMULATION_ENCODING;
+    return response;
+}
+
+static Response makeError(int code, const std::string& message)
+{
+    json body;
+    body["error"] = message;
+    return makeResponse(code, body.dump());
+}
+
+static std::string headerValue(const Headers& headers, const std::string& name)
+{
+    for (const auto& header : headers) {
+        if (header.first.size() == name.size() &&
+            std::equal(name.begin(), name.end(), header.first.begin(), [](char a, char b) {
+                return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+            })) {
+            return header.second;
+        }
+    }
+    return "";
+}
+
+static json recordToJson(const Record& record)
+{
+    // The list endpoint uses 'content' and 'prio'
+    json data;
+    data["name"] = record.name;
+    data["type"] = record.type;
+    data["content"] = record.content;
+    data["ttl"] = record.ttl;
+    data["prio"] = record.priority;
+    return data;
+}
+
+static json writtenRecordToJson(const Record& record)
+{
+    // Create and update answer with 'data' and 'priority'
+    json data;
+    data["name"] = record.name;
+    data["type"] = record.type;
+    data["data"] = record.content;
+    data["ttl"] = record.ttl;
+    data["priority"] = record.priority;
+    return data;
+}
+
+LopDnsApiSimulation::LopDnsApiSimulation(const SimulationSettings& settings)
+    : settings(settings), random(settings.seed)
+{
+    populate();
+}
+
+std::vector<std::string> LopDnsApiSimulation::zoneNames()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> names;
+    for (const auto& zone : zones) {
+        names.push_back(zone.first);
+    }
+    return names;
+}
+
+void LopDnsApiSimulation::populate()
+{
+    for (int z = 0; z < settings.zoneCount; z++) {
+        std::string zone = "zone" + std::to_string(z) + ".example";
+        auto& records = zones[zone];
+        records.reserve(settings.recordsPerZone);
+        for (int r = 0; r < settings.recordsPerZone; r++) {
+            Record record;
+            record.type = SIMULATION_RECORD_TYPES[r % 5];
+            record.name = "host" + std::to_string(r) + "." + zone;
+            record.ttl = 3600;
+            record.priority = record.type == "MX" ? 10 : 0;
+            if (record.type == "A") {
+                record.content = "192.0.2." + std::to_string(r % 256);
+            } else if (record.type == "AAAA") {
+                record.content = "2001:db8::" + std::to_string(r);
+            } else if (record.type == "CNAME" || record.type == "MX") {
+                record.content = "target" + std::to_string(r) + "." + zone;
+            } else {
+                record.content = "v=spf1 ip4:192.0.2." + std::to_string(r % 256) + " -all";
+            }
+            records.push_back(record);
+        }
+    }
+}
+
+Response LopDnsApiSimulation::handle(const std::string& method, const std::string& path, const Headers& headers,
+                                     const QueryParams& queryParams, const std::string& body)
+{
+    requests++;
+    if (settings.latencyInMilliseconds > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(settings.latencyInMilliseconds));
+    }
+    if (settings.errorRate > 0.0) {
+        bool fail;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fail = std::uniform_real_distribution<double>(0.0, 1.0)(random) < settings.errorRate;
+        }
+        if (fail) {
+            return makeError(503, "injected error");
+        }
+    }
+
+    if (path.compare(0, SIMULATION_PREFIX.size(), SIMULATION_PREFIX) != 0) {
+        return makeError(404, "not found");
+    }
+    std::string endpoint = path.substr(SIMULATION_PREFIX.size());
+    if (method == "GET" && endpoint == "/auth/token") {
+        return handleToken(headers, queryParams);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tokens.count(headerValue(headers, "x-token")) == 0) {
+            return makeError(401, "invalid token");
+        }
+    }
+    if (method == "GET" && endpoint == "/auth/validate") {
+        return makeResponse(200, "{\"valid\":true}");
+    }
+    if (method == "GET" && endpoint == "/auth/invalidate") {
+        return handleInvalidate(headers);
+    }
+    if (method == "GET" && endpoint == "/zones") {
+        return handleZones();
+    }
+
+    const std::string recordsPrefix = "/records/";
+    if (endpoint.compare(0, recordsPrefix.size(), recordsPrefix) != 0 || endpoint.size() == recordsPrefix.size()
+        || endpoint.find('/', recordsPrefix.size()) != std::string::npos) {
+        return makeError(404, "not found");
+    }
+    std::string zone = endpoint.substr(recordsPrefix.size());
+    if (method == "GET") {
+        return handleGetRecords(zone, headers);
+    }
+    if (method == "POST") {
+        return handleCreateRecord(zone, body);
+    }
+    if (method == "PUT") {
+        return handleUpdateRecord(zone, body);
+    }
+    if (method == "DELETE") {
+        return handleDeleteRecord(zone, body);
+    }
+    return makeError(405, "method not allowed");
+}
+
+Response LopDnsApiSimulation::handleToken(const Headers& headers, const QueryParams& queryParams)
+{
+    if (headerValue(headers, "x-clientid").empty()) {
+        return makeError(401, "missing client id");
+    }
+    long long duration = 3600;
+    auto durationParam = queryParams.find("duration");
+    if (durationParam != queryParams.end()) {
+        try
+        {
+            duration = std::stoll(durationParam->second);
+        }
+        catch (const std::exception&)
+        {
+            return makeError(400, "invalid duration");
+        }
+    }
+
+    json body;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string token = "mock-token-" + std::to_string(random());
+        tokens.insert(token);
+        body["token"] = token;
+    }
+    long long expires = (long long)time(nullptr) + duration;
+    body["expires"] = std::to_string(expires);
+    body["epochExpires"] = expires;
+    body["tz"] = "UTC";
+    return makeResponse(200, body.dump());
+}
+
+Response LopDnsApiSimulation::handleInvalidate(const Headers& headers)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    tokens.erase(headerValue(headers, "x-token"));
+    return makeResponse(200, "{}");
+}
+
+Response LopDnsApiSimulation::handleZones()
+{
+    json body = json::array();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& zone : zones) {
+        body.push_back(zone.first);
+    }
+    return makeResponse(200, body.dump());
+}
+
+Response LopDnsApiSimulation::handleGetRecords(const std::string& zone, const Headers& headers)
+{
+    json body = json::array();
+    std::string etag;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = zones.find(zone);
+        if (it == zones.end()) {
+            return makeError(404, "zone not found");
+        }
+        etag = "\"" + std::to_string(zoneVersions[it->first]) + "\"";
+        if (headerValue(headers, "If-None-Match") == etag) {
+            Response notModified;
+            notModified.code = 304;
+            notModified.headers["ETag"] = etag;
+            return notModified;
+        }
+        for (const auto& record : it->second) {
+            body.push_back(recordToJson(record));
+        }
+    }
+    Response response = makeResponse(200, body.dump());
+    response.headers["ETag"] = etag;
+    return response;
+}
+
+Response LopDnsApiSimulation::handleCreateRecord(const std::string& zone, const std::string& body)
+{
+    Record record;
+    try
+    {
+        json data = json::parse(body);
+        record.name = data.at("name").get<std::string>();
+        record.type = data.at("type").get<std::string>();
+        record.content = data.at("value").get<std::string>();
+        record.ttl = data.value("ttl", 3600);
+        record.priority = data.value("priority", 0);
+    }
+    catch (const std::exception& e)
+    {
+        return makeError(400, e.what());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = zones.find(zone);
+        if (it == zones.end()) {
+            return makeError(404, "zone not found");
+        }
+        it->second.push_back(record);
+        zoneVersions[it->first]++;
+    }
+    return makeResponse(200, writtenRecordToJson(record).dump());
+}
+
+Response LopDnsApiSimulation::handleUpdateRecord(const std::string& zone, const std::string& body)
+{
+    json data;
+    try
+    {
+        data = json::parse(body);
+    }
+    catch (const std::exception& e)
+    {
+        return makeError(400, e.what());
+    }
+
+    Record updated;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = zones.find(zone);
+        if (it == zones.end()) {
+            return makeError(404, "zone not found");
+        }
+        Record* match = nullptr;
+        for (auto& record : it->second) {
+            if (record.name == data.value("oldName", "") && record.type == data.value("matchingType", "")
+                && record.content == data.value("oldValue", "")) {
+                match = &record;
+                break;
+            }
+        }
+        if (match == nullptr) {
+            return makeError(404, "record not found");
+        }
+        match->name = data.value("newName", match->name);
+        match->type = data.value("newType", match->type);
+        match->content = data.value("newValue", match->content);
+        match->ttl = data.value("newTtl", match->ttl);
+        match->priority = data.value("newPriority", match->priority);
+        updated = *match;
+        zoneVersions[it->first]++;
+    }
+    return makeResponse(200, writtenRecordToJson(updated).dump());
+}
+
+Response LopDnsApiSimulation::handleDeleteRecord(const std::string& zone, const std::string& body)
+{
+    if (settings.deleteReturns500) {
+        return makeError(500, "internal server error");
+    }
+
+    json data;
+    try
+    {
+        data = json::parse(body);
+    }
+    catch (const std::exception& e)
+    {
+        return makeError(400, e.what());
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = zones.find(zone);
+    if (it == zones.end()) {
+        return makeError(404, "zone not found");
+    }
+    auto& records = it->second;
+    for (auto record = records.begin(); record != records.end(); ++record) {
+        if (record->name == data.value("name", "") && record->type == data.value("type", "")
+            && record->content == data.value("value", "")) {
+            records.erase(record);
+            zoneVersions[it->first]++;
+            return makeResponse(200, "{}");
+        }
+    }
+    return makeError(404, "record not found");
+}
@@ -0,0 +1,63 @@
+#ifndef APISIMULATION_H
+#define APISIMULATION_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include "lopdnsclient.h"
+
+typedef struct SimulationSettings
+{
+    int zoneCount = 3;
+    int recordsPerZone = 100;
+    // Added to every request before it is answered
+    int latencyInMilliseconds = 0;
+    // Fraction of requests (0.0 - 1.0) answered with a 503 instead of being handled
+    double errorRate = 0.0;
+    // The real API answers every DELETE /records with a 500 without deleting anything
+    bool deleteReturns500 = true;
+    unsigned int seed = 1;
+} SimulationSettings;
+
+// In-memory state of the LOP DNS API endpoints used by LopDnsClient, including the documented
+// deviations from the API docs: zones are returned as bare strings, records use 'content' and
+// 'prio' instead of 'value' and 'priority', and deleting fails with 500. Served over HTTP by
+// MockLopDnsServer and in-process by FakeTransport. Safe to call from several threads.
+class LopDnsApiSimulation
+{
+public:
+    explicit LopDnsApiSimulation(const SimulationSettings& settings = SimulationSettings());
+
+    // Answers a request for a path like /v2/records/example.com, header names are case insensitive
+    Response handle(const std::string& method, const std::string& path, const Headers& headers,
+                    const QueryParams& queryParams, const std::string& body);
+
+    long long requestCount() const { return requests.load(); }
+    std::vector<std::string> zoneNames();
+    const SimulationSettings& getSettings() const { return settings; }
+
+private:
+    Response handleToken(const Headers& headers, const QueryParams& queryParams);
+    Response handleInvalidate(const Headers& headers);
+    Response handleZones();
+    Response handleGetRecords(const std::string& zone, const Headers& headers);
+    Response handleCreateRecord(const std::string& zone, const std::string& body);
+    Response handleUpdateRecord(const std::string& zone, const std::string& body);
+    Response handleDeleteRecord(const std::string& zone, const std::string& body);
+    void populate();
+
+    SimulationSettings settings;
+    std::map<std::string, std::vector<Record>> zones;
+    // Bumped on every change of a zone and sent as its ETag
+    std::map<std::string, long long> zoneVersions;
+    std::set<std::string> tokens;
+    std::mutex mutex;
+    std::mt19937 random;
+    std::atomic<long long> requests{0};
+};
+
+#endif // APISIMULATION_H
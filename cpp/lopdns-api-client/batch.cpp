@@ -0,0 +1,426 @@
+#include "nlohmann/json.hpp"
+#include "logging.h"
+
+#include "batch.h"
+#include "workerpool.h"
+#include "zoneindex.h"
+#include <map>
+#include <set>
+#include <mutex>
+#include <tuple>
+#include <memory>
+#include <algorithm>
+
+using json = nlohmann::json;
+
+constexpr int defaultBatchRecordTtl = 3600;
+constexpr int defaultBatchRecordPriority = 0;
+
+const std::map<std::string, BatchActionType> batchActionMap = {
+    {"create-record", BATCH_CREATE_RECORD},
+    {"update-record", BATCH_UPDATE_RECORD},
+    {"createorupdate-record", BATCH_CREATE_OR_UPDATE_RECORD},
+    {"delete-record", BATCH_DELETE_RECORD}};
+
+struct BatchProcessor::ZoneState
+{
+    std::string zone;
+    bool available = false;
+    bool needsRecords = false;
+    // Operations on a zone whose records could not be fetched fail, an empty index would turn
+    // every update into a create
+    bool fetchFailed = false;
+    ZoneIndex records;
+    std::mutex mutex;
+};
+
+// Whether applying the new values of an update operation to the record changes anything
+static bool changesRecord(const BatchOperation& operation, const Record& record)
+{
+    return (operation.newName.has_value() && operation.newName.value() != record.name)
+        || (operation.newType.has_value() && operation.newType.value() != record.type)
+        || (operation.newContent.has_value() && operation.newContent.value() != record.content)
+        || (operation.ttl.has_value() && operation.ttl.value() != record.ttl)
+        || (operation.priority.has_value() && operation.priority.value() != record.priority);
+}
+
+static std::optional<std::string> optionalString(const json& data, const char* key)
+{
+    auto it = data.find(key);
+    if (it == data.end() || it->is_null()) {
+        return std::nullopt;
+    }
+    if (!it->is_string()) {
+        throw std::runtime_error(std::string("'") + key + "' must be a string");
+    }
+    return it->get<std::string>();
+}
+
+static std::optional<int> optionalInt(const json& data, const char* key)
+{
+    auto it = data.find(key);
+    if (it == data.end() || it->is_null()) {
+        return std::nullopt;
+    }
+    if (!it->is_number_integer()) {
+        throw std::runtime_error(std::string("'") + key + "' must be an integer");
+    }
+    return it->get<int>();
+}
+
+BatchProcessor::BatchProcessor(LopDnsClient& client, int concurrency, bool dryRun)
+    : client(client)
+{
+    this->concurrency = concurrency;
+    this->dryRun = dryRun;
+}
+
+bool BatchProcessor::parseOperation(const std::string& line, size_t lineNumber, BatchOperation& operation, std::string& error)
+{
+    try
+    {
+        json data = json::parse(line);
+        if (!data.is_object()) {
+            error = "expected a JSON object";
+            return false;
+        }
+
+        operation.line = lineNumber;
+        operation.actionName = optionalString(data, "action").value_or("");
+        auto it = batchActionMap.find(operation.actionName);
+        if (it == batchActionMap.end()) {
+            error = "invalid action '" + operation.actionName + "'";
+            return false;
+        }
+        operation.action = it->second;
+        operation.zone = optionalString(data, "zone").value_or("");
+        operation.name = optionalString(data, "name").value_or("");
+        operation.type = optionalString(data, "type").value_or("");
+        operation.content = optionalString(data, "content");
+        operation.newContent = optionalString(data, "newContent");
+        operation.newName = optionalString(data, "newName");
+        operation.newType = optionalString(data, "newType");
+        operation.ttl = optionalInt(data, "ttl");
+        operation.priority = optionalInt(data, "priority");
+        operation.allRecords = data.value("allRecords", false);
+    }
+    catch (const std::exception& e)
+    {
+        error = e.what();
+        return false;
+    }
+
+    if (operation.zone.empty() || operation.name.empty() || operation.type.empty()) {
+        error = "'zone', 'name' and 'type' are required";
+        return false;
+    }
+    switch (operation.action) {
+        case BATCH_CREATE_RECORD:
+            if (!operation.content.has_value() && !operation.newContent.has_value()) {
+                error = "'content' is required to create a record";
+                return false;
+            }
+            break;
+        case BATCH_UPDATE_RECORD:
+            if (!operation.newContent.has_value() && !operation.newName.has_value() && !operation.newType.has_value()
+                && !operation.ttl.has_value() && !operation.priority.has_value()) {
+                error = "nothing to update";
+                return false;
+            }
+            break;
+        case BATCH_CREATE_OR_UPDATE_RECORD:
+            if (!operation.newContent.has_value()) {
+                error = "'newContent' is required to create or update a record";
+                return false;
+            }
+            break;
+        case BATCH_DELETE_RECORD:
+            break;
+    }
+    return true;
+}
+
+size_t BatchProcessor::readOperations(std::istream& input)
+{
+    size_t count = 0;
+    size_t lineNumber = 0;
+    std::string line;
+    while (std::getline(input, line))
+    {
+        lineNumber++;
+        auto start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+
+        BatchOperation operation;
+        std::string error;
+        if (parseOperation(line, lineNumber, operation, error)) {
+            addOperation(operation);
+            count++;
+        }
+        else {
+            LOG_ERROR << "Invalid batch operation on line " << lineNumber << ": " << error;
+            BatchResult result{lineNumber, operation.actionName, operation.zone, operation.name, operation.type,
+                               false, "invalid", error};
+            invalidOperations.push_back(result);
+        }
+    }
+    LOG_DEBUG << "Read " << count << " batch operations from " << lineNumber << " lines.";
+    return count;
+}
+
+void BatchProcessor::addOperation(const BatchOperation& operation)
+{
+    operations.push_back(operation);
+}
+
+std::vector<BatchResult> BatchProcessor::apply(const std::vector<std::string>& availableZones)
+{
+    // An update that renames or retypes records moves them to another chain, so a zone with such
+    // an update is applied as a single chain to keep its operations in file order
+    std::set<std::string> serialZones;
+    for (const auto& operation : operations) {
+        if (operation.action == BATCH_UPDATE_RECORD || operation.action == BATCH_CREATE_OR_UPDATE_RECORD) {
+            if ((operation.newName.has_value() && operation.newName.value() != operation.name)
+                || (operation.newType.has_value() && operation.newType.value() != operation.type)) {
+                serialZones.insert(operation.zone);
+            }
+        }
+    }
+
+    // Group the operations by zone, and within a zone into chains on the same record name and type
+    std::map<std::string, std::unique_ptr<ZoneState>> zoneStates;
+    std::map<std::tuple<std::string, std::string, std::string>, std::vector<size_t>> chainMap;
+    for (size_t i = 0; i < operations.size(); i++) {
+        const BatchOperation& operation = operations[i];
+        auto& zoneState = zoneStates[operation.zone];
+        if (!zoneState) {
+            zoneState = std::make_unique<ZoneState>();
+            zoneState->zone = operation.zone;
+            zoneState->available = std::find(availableZones.begin(), availableZones.end(), operation.zone) != availableZones.end();
+        }
+        if (operation.action != BATCH_CREATE_RECORD) {
+            zoneState->needsRecords = true;
+        }
+        if (serialZones.count(operation.zone)) {
+            chainMap[std::make_tuple(operation.zone, "", "")].push_back(i);
+        } else {
+            chainMap[std::make_tuple(operation.zone, operation.name, operation.type)].push_back(i);
+        }
+    }
+
+    // Every zone is fetched once, no matter how many operations it has
+    std::vector<ZoneState*> zonesToFetch;
+    for (auto& zoneState : zoneStates) {
+        if (zoneState.second->available && zoneState.second->needsRecords) {
+            zonesToFetch.push_back(zoneState.second.get());
+        }
+    }
+    LOG_DEBUG << "Fetching records for " << zonesToFetch.size() << " zones.";
+    parallelMap(zonesToFetch, concurrency, [this](ZoneState* zoneState) {
+        std::vector<Record> records;
+        if (!client.getRecords(zoneState->zone, records)) {
+            LOG_ERROR << "Failed to fetch the records of zone " << zoneState->zone << ".";
+            zoneState->fetchFailed = true;
+            return size_t(0);
+        }
+        zoneState->records.assign(std::move(records));
+        return zoneState->records.size();
+    });
+
+    std::vector<std::vector<size_t>> chains;
+    chains.reserve(chainMap.size());
+    for (auto& chain : chainMap) {
+        chains.push_back(std::move(chain.second));
+    }
+    LOG_DEBUG << "Applying " << operations.size() << " batch operations in " << chains.size() << " chains.";
+    auto chainResults = parallelMap(chains, concurrency, [this, &zoneStates](const std::vector<size_t>& chain) {
+        std::vector<BatchResult> results;
+        for (size_t index : chain) {
+            const BatchOperation& operation = operations[index];
+            results.push_back(applyOperation(operation, *zoneStates.at(operation.zone)));
+        }
+        return results;
+    });
+
+    std::vector<BatchResult> results = invalidOperations;
+    for (auto& chainResult : chainResults) {
+        results.insert(results.end(), chainResult.begin(), chainResult.end());
+    }
+    std::stable_sort(results.begin(), results.end(), [](const BatchResult& a, const BatchResult& b) {
+        return a.line < b.line;
+    });
+    return results;
+}
+
+BatchResult BatchProcessor::applyOperation(const BatchOperation& operation, ZoneState& zoneState)
+{
+    BatchResult result{operation.line, operation.actionName, operation.zone, operation.name, operation.type,
+                       false, "failed", ""};
+    if (!zoneState.available) {
+        result.message = "zone not found";
+        return result;
+    }
+    if (zoneState.fetchFailed && operation.action != BATCH_CREATE_RECORD) {
+        result.message = "failed to fetch the records of the zone";
+        return result;
+    }
+
+    auto findMatches = [&operation, &zoneState]() {
+        std::lock_guard<std::mutex> lock(zoneState.mutex);
+        std::vector<Record> matches;
+        if (operation.content.has_value()) {
+            const Record* record = zoneState.records.find(operation.name, operation.type, operation.content.value());
+            if (record != nullptr) {
+                matches.push_back(*record);
+            }
+            return matches;
+        }
+        matches = zoneState.records.find(operation.name, operation.type);
+        if (!operation.allRecords && matches.size() > 1) {
+            matches.resize(1);
+        }
+        return matches;
+    };
+
+    // In a dry run the changes are only made to the index, so that later operations of the chain
+    // see the zone as a real run would leave it
+    auto createRecord = [this, &operation, &zoneState](const std::string& content) {
+        Record record{operation.name, operation.type, content, operation.ttl.value_or(defaultBatchRecordTtl),
+                      operation.priority.value_or(defaultBatchRecordPriority)};
+        if (!dryRun) {
+            record = client.createRecord(operation.zone, operation.name, operation.type, content,
+                                         record.ttl, record.priority);
+            if (record.name.empty()) {
+                return false;
+            }
+        }
+        std::lock_guard<std::mutex> lock(zoneState.mutex);
+        zoneState.records.insert(record);
+        return true;
+    };
+
+    auto updateRecord = [this, &operation, &zoneState](const Record& record) {
+        Record updated{operation.newName.value_or(record.name), operation.newType.value_or(record.type),
+                       operation.newContent.value_or(record.content), operation.ttl.value_or(record.ttl),
+                       operation.priority.value_or(record.priority)};
+        if (!dryRun) {
+            updated = client.updateRecord(operation.zone, record.name, record.type, record.content,
+                                          operation.newName, operation.newType, operation.newContent,
+                                          operation.ttl, operation.priority);
+            if (updated.name.empty()) {
+                return false;
+            }
+        }
+        std::lock_guard<std::mutex> lock(zoneState.mutex);
+        zoneState.records.update(record.name, record.type, record.content, updated);
+        return true;
+    };
+
+    auto deleteRecord = [this, &operation, &zoneState](const Record& record) {
+        if (!dryRun && !client.deleteRecord(operation.zone, record.name, record.type, record.content)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(zoneState.mutex);
+        zoneState.records.erase(record.name, record.type, record.content);
+        return true;
+    };
+
+    const std::string done = dryRun ? "dry-run" : "ok";
+    switch (operation.action) {
+        case BATCH_CREATE_RECORD:
+        {
+            if (createRecord(operation.content.has_value() ? operation.content.value() : operation.newContent.value())) {
+                result.success = true;
+                result.status = done;
+                result.message = "created";
+            }
+            else {
+                result.message = "failed to create record";
+            }
+            break;
+        }
+        case BATCH_UPDATE_RECORD:
+        case BATCH_CREATE_OR_UPDATE_RECORD:
+        {
+            auto matches = findMatches();
+            if (matches.empty()) {
+                if (operation.action == BATCH_UPDATE_RECORD) {
+                    result.status = "not-found";
+                    result.message = "no matching record";
+                }
+                else if (createRecord(operation.newContent.value())) {
+                    result.success = true;
+                    result.status = done;
+                    result.message = "created";
+                }
+                else {
+                    result.message = "failed to create record";
+                }
+                break;
+            }
+            // Records that already have the new values are not sent to the API
+            size_t updated = 0;
+            size_t unchanged = 0;
+            for (const auto& record : matches) {
+                if (!changesRecord(operation, record)) {
+                    unchanged++;
+                    continue;
+                }
+                if (!updateRecord(record)) {
+                    result.message = "failed to update record with content '" + record.content + "'";
+                    break;
+                }
+                updated++;
+            }
+            if (updated + unchanged == matches.size()) {
+                result.success = true;
+                result.status = updated == 0 ? "unchanged" : done;
+                result.message = "updated " + std::to_string(updated) + " record(s)";
+                if (unchanged > 0) {
+                    result.message += ", " + std::to_string(unchanged) + " unchanged";
+                }
+            }
+            break;
+        }
+        case BATCH_DELETE_RECORD:
+        {
+            auto matches = findMatches();
+            if (matches.empty()) {
+                result.status = "not-found";
+                result.message = "no matching record";
+                break;
+            }
+            size_t deleted = 0;
+            for (const auto& record : matches) {
+                if (!deleteRecord(record)) {
+                    result.message = "failed to delete record with content '" + record.content + "'";
+                    break;
+                }
+                deleted++;
+            }
+            if (deleted == matches.size()) {
+                result.success = true;
+                result.status = done;
+                result.message = "deleted " + std::to_string(deleted) + " record(s)";
+            }
+            break;
+        }
+    }
+    return result;
+}
+
+void BatchProcessor::writeResult(std::ostream& output, const BatchResult& result)
+{
+    json data;
+    data["line"] = result.line;
+    data["action"] = result.action;
+    data["zone"] = result.zone;
+    data["name"] = result.name;
+    data["type"] = result.type;
+    data["success"] = result.success;
+    data["status"] = result.status;
+    data["message"] = result.message;
+    output << data.dump() << "\n";
+}
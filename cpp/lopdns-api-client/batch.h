@@ -0,0 +1,83 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <list>
+#include <vector>
+#include <optional>
+#include <istream>
+#include <ostream>
+#include "lopdnsclient.h"
+
+typedef enum BatchActionType {
+    BATCH_CREATE_RECORD,
+    BATCH_UPDATE_RECORD,
+    BATCH_CREATE_OR_UPDATE_RECORD,
+    BATCH_DELETE_RECORD
+} BatchActionType;
+
+// A single line of a batch file, e.g.
+// {"action": "update-record", "zone": "example.com", "name": "www.example.com", "type": "A", "content": "1.2.3.4", "newContent": "5.6.7.8"}
+typedef struct BatchOperation
+{
+    size_t line;
+    BatchActionType action;
+    std::string actionName;
+    std::string zone;
+    std::string name;
+    std::string type;
+    // Current content, matched exactly. Without it all records with the name and type match.
+    std::optional<std::string> content;
+    std::optional<std::string> newContent;
+    std::optional<std::string> newName;
+    std::optional<std::string> newType;
+    std::optional<int> ttl;
+    std::optional<int> priority;
+    bool allRecords;
+} BatchOperation;
+
+typedef struct BatchResult
+{
+    size_t line;
+    std::string action;
+    std::string zone;
+    std::string name;
+    std::string type;
+    bool success;
+    std::string status;
+    std::string message;
+} BatchResult;
+
+class BatchProcessor
+{
+public:
+    BatchProcessor(LopDnsClient& client, int concurrency = 4, bool dryRun = false);
+
+    // Reads one operation per line until the end of the stream. Empty lines and
+    // lines starting with '#' are skipped, invalid lines are reported as failed results.
+    size_t readOperations(std::istream& input);
+    void addOperation(const BatchOperation& operation);
+
+    // Fetches the records of every zone once and applies the operations. Operations on the same
+    // record name and type are applied in file order, all others run with bounded concurrency.
+    // All operations of a zone with an update that changes a name or type are applied in file
+    // order. Operations that need the records of a zone that could not be fetched fail.
+    // The results are returned in file order.
+    std::vector<BatchResult> apply(const std::vector<std::string>& availableZones);
+
+    static bool parseOperation(const std::string& line, size_t lineNumber, BatchOperation& operation, std::string& error);
+    static void writeResult(std::ostream& output, const BatchResult& result);
+
+private:
+    struct ZoneState;
+
+    BatchResult applyOperation(const BatchOperation& operation, ZoneState& zoneState);
+
+    LopDnsClient& client;
+    int concurrency;
+    bool dryRun;
+    std::vector<BatchOperation> operations;
+    std::vector<BatchResult> invalidOperations;
+};
+
+#endif // BATCH_H
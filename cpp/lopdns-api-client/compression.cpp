@@ -0,0 +1,107 @@
+#include "compression.h"
+
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+// Output is inflated in steps of this many bytes
+constexpr size_t decodeChunkSize = 64 * 1024;
+
+StreamingDecoder::StreamingDecoder(const std::string& contentEncoding, std::string& output)
+    : output(output)
+{
+    this->encoding = contentEncoding;
+}
+
+StreamingDecoder::~StreamingDecoder()
+{
+    if (initialized) {
+        inflateEnd(&stream);
+    }
+}
+
+// The window bits select the wrapper: 16 + 15 gzip, 15 zlib, -15 raw deflate
+bool StreamingDecoder::start(const char* data)
+{
+    int windowBits = 16 + MAX_WBITS;
+    if (encoding == "deflate") {
+        // A zlib header is a multiple of 31 with compression method 8
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        bool zlibWrapped = ((bytes[0] & 0x0f) == Z_DEFLATED && (bytes[0] * 256 + bytes[1]) % 31 == 0);
+        windowBits = zlibWrapped ? MAX_WBITS : -MAX_WBITS;
+    }
+    initialized = inflateInit2(&stream, windowBits) == Z_OK;
+    return initialized;
+}
+
+bool StreamingDecoder::write(const char* data, size_t length)
+{
+    if (length == 0) {
+        return true;
+    }
+    if (finished) {
+        // Trailing data after the end of the stream
+        return false;
+    }
+    std::string firstBytes;
+    if (!initialized) {
+        // The wrapper of a deflate body is told by its first two bytes, which may arrive apart
+        firstBytes = pending + std::string(data, length);
+        if (encoding == "deflate" && firstBytes.size() < 2) {
+            pending = firstBytes;
+            return true;
+        }
+        if (!start(firstBytes.data())) {
+            return false;
+        }
+        pending.clear();
+        data = firstBytes.data();
+        length = firstBytes.size();
+    }
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(length);
+    // A full output step may leave decoded bytes pending in zlib after all input is consumed
+    do {
+        size_t offset = output.size();
+        output.resize(offset + decodeChunkSize);
+        stream.next_out = reinterpret_cast<Bytef*>(&output[offset]);
+        stream.avail_out = static_cast<uInt>(decodeChunkSize);
+        int result = inflate(&stream, Z_NO_FLUSH);
+        output.resize(offset + decodeChunkSize - stream.avail_out);
+        if (result == Z_STREAM_END) {
+            finished = true;
+        } else if (result == Z_BUF_ERROR) {
+            // No progress possible until more input arrives
+            break;
+        } else if (result != Z_OK) {
+            return false;
+        }
+    } while (!finished && (stream.avail_in > 0 || stream.avail_out == 0));
+    return true;
+}
+
+bool gzipCompress(const std::string& input, std::string& output)
+{
+    z_stream stream = {};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    output.resize(deflateBound(&stream, static_cast<uLong>(input.size())));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+    int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
+
+std::string supportedContentEncodings()
+{
+    return "gzip, deflate";
+}
+#else
+std::string supportedContentEncodings()
+{
+    return "";
+}
+#endif
@@ -0,0 +1,47 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <string>
+
+// gzip and deflate support for HttpTransport, only available if the client is built with
+// CPPHTTPLIB_ZLIB_SUPPORT (see the Makefile)
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+#include <zlib.h>
+
+// Decodes a gzip or deflate encoded body chunk by chunk as it is received, appending the
+// decoded bytes to output. HTTP "deflate" is zlib wrapped, raw deflate is accepted as well
+// since some servers send it.
+class StreamingDecoder
+{
+public:
+    StreamingDecoder(const std::string& contentEncoding, std::string& output);
+    ~StreamingDecoder();
+
+    StreamingDecoder(const StreamingDecoder&) = delete;
+    StreamingDecoder& operator=(const StreamingDecoder&) = delete;
+
+    // False if the data is not valid for the encoding
+    bool write(const char* data, size_t length);
+    // False if the body ended before the compressed stream did
+    bool finish() const { return finished; }
+
+private:
+    // data holds at least the first two bytes of a deflate body
+    bool start(const char* data);
+
+    std::string encoding;
+    std::string& output;
+    std::string pending;
+    z_stream stream = {};
+    bool initialized = false;
+    bool finished = false;
+};
+
+// gzip encodes a request body, false if zlib failed
+bool gzipCompress(const std::string& input, std::string& output);
+#endif
+
+// Content-Encoding values the transport can decode, empty if built without zlib
+std::string supportedContentEncodings();
+
+#endif // COMPRESSION_H
@@ -0,0 +1,162 @@
+#include "logging.h"
+
+#include "connectionpool.h"
+
+PooledConnection::PooledConnection(ConnectionPool* pool, std::unique_ptr<httplib::Client> client, bool reused)
+    : pool(pool), connection(std::move(client)), reused(reused)
+{
+}
+
+PooledConnection::PooledConnection(PooledConnection&& other) noexcept
+    : pool(other.pool), connection(std::move(other.connection)), reused(other.reused)
+{
+    other.pool = nullptr;
+}
+
+PooledConnection::~PooledConnection()
+{
+    if (pool != nullptr && connection) {
+        pool->release(std::move(connection), true);
+    }
+}
+
+void PooledConnection::discard()
+{
+    if (pool != nullptr && connection) {
+        pool->release(std::move(connection), false);
+    }
+}
+
+ConnectionPool::ConnectionPool(const std::string& host, int timeoutInSeconds, const ConnectionPoolSettings& settings)
+{
+    this->host = host;
+    this->timeout = timeoutInSeconds;
+    this->settings = settings;
+    if (this->settings.maxConnections < 1) {
+        this->settings.maxConnections = 1;
+    }
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    clear();
+}
+
+PooledConnection ConnectionPool::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        // Prefer the most recently used connection, it is the most likely to still be alive
+        auto now = std::chrono::steady_clock::now();
+        while (!idleConnections.empty())
+        {
+            IdleConnection idle = std::move(idleConnections.back());
+            idleConnections.pop_back();
+            stats.idle--;
+            if (isReusable(idle, now)) {
+                stats.reused++;
+                LOG_DEBUG << "Reusing pooled connection to '" << host << "' (reused: " << stats.reused
+                          << ", created: " << stats.created << ", open: " << stats.open << ")";
+                return PooledConnection(this, std::move(idle.client), true);
+            }
+            stats.evicted++;
+            stats.open--;
+            idle.client->stop();
+        }
+
+        if (stats.open < settings.maxConnections) {
+            stats.open++;
+            stats.created++;
+            LOG_DEBUG << "Opening new pooled connection to '" << host << "' (created: " << stats.created
+                      << ", open: " << stats.open << "/" << settings.maxConnections << ")";
+            lock.unlock();
+            try
+            {
+                return PooledConnection(this, createConnection(), false);
+            }
+            catch (...)
+            {
+                lock.lock();
+                stats.open--;
+                stats.created--;
+                connectionReleased.notify_one();
+                throw;
+            }
+        }
+
+        LOG_DEBUG << "All " << settings.maxConnections << " connections to '" << host << "' are busy, waiting";
+        connectionReleased.wait(lock);
+    }
+}
+
+void ConnectionPool::release(std::unique_ptr<httplib::Client> client, bool reusable)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (reusable && settings.idleTimeoutInSeconds > 0) {
+        idleConnections.push_back(IdleConnection{std::move(client), std::chrono::steady_clock::now()});
+        stats.idle++;
+    }
+    else {
+        LOG_DEBUG << "Closing connection to '" << host << "'";
+        client->stop();
+        stats.open--;
+        stats.evicted++;
+    }
+    connectionReleased.notify_one();
+}
+
+ConnectionPoolStats ConnectionPool::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void ConnectionPool::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& idle : idleConnections) {
+        idle.client->stop();
+        stats.open--;
+        stats.evicted++;
+    }
+    idleConnections.clear();
+    stats.idle = 0;
+}
+
+std::unique_ptr<httplib::Client> ConnectionPool::createConnection()
+{
+    std::string schemeHostPort = host.find("://") == std::string::npos ? "https://" + host : host;
+    auto client = std::make_unique<httplib::Client>(schemeHostPort);
+    if (!client->is_valid()) {
+        throw std::runtime_error("Invalid API host: " + host);
+    }
+
+    LOG_DEBUG << "Setting timeouts to " << timeout << " seconds.";
+    client->set_connection_timeout(timeout, 0);
+    client->set_read_timeout(timeout, 0);
+    client->set_write_timeout(timeout, 0);
+
+    LOG_DEBUG << "Setting connection properties ";
+    client->set_keep_alive(true);
+    client->set_follow_location(true);
+    client->enable_server_certificate_verification(true);
+    // Compressed responses are decoded by the transport, which counts the bytes on the wire
+    client->set_decompress(false);
+
+    return client;
+}
+
+bool ConnectionPool::isReusable(const IdleConnection& connection, const std::chrono::steady_clock::time_point& now)
+{
+    auto idleTime = std::chrono::duration_cast<std::chrono::seconds>(now - connection.lastUsed).count();
+    if (idleTime >= settings.idleTimeoutInSeconds) {
+        LOG_DEBUG << "Evicting connection to '" << host << "' idle for " << idleTime << " seconds";
+        return false;
+    }
+    if (settings.healthCheck && !connection.client->is_socket_open()) {
+        LOG_DEBUG << "Evicting connection to '" << host << "' with closed socket";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#ifndef CPPHTTPLIB_OPENSSL_SUPPORT
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#endif
+#include "httplib.h"
+
+typedef struct ConnectionPoolSettings
+{
+    // Upper bound of open connections per host, callers wait for a free one when reached
+    int maxConnections = 4;
+    // Idle connections older than this are closed instead of being reused
+    int idleTimeoutInSeconds = 30;
+    // Verify that the socket of an idle connection is still open before reusing it
+    bool healthCheck = true;
+    // Ask for gzip or deflate encoded responses, needs a build with zlib
+    bool compressResponses = true;
+    // Request bodies of at least this many bytes are sent gzip encoded, 0 disables it
+    size_t compressRequestsFromBytes = 0;
+} ConnectionPoolSettings;
+
+typedef struct ConnectionPoolStats
+{
+    long long created = 0;
+    long long reused = 0;
+    // Closed connections, created is always open + evicted
+    long long evicted = 0;
+    int open = 0;
+    int idle = 0;
+} ConnectionPoolStats;
+
+class ConnectionPool;
+
+// A connection leased from a ConnectionPool, handed back to the pool when it goes out of scope
+class PooledConnection
+{
+public:
+    PooledConnection(ConnectionPool* pool, std::unique_ptr<httplib::Client> client, bool reused);
+    PooledConnection(PooledConnection&& other) noexcept;
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+    ~PooledConnection();
+
+    httplib::Client& client() { return *connection; }
+    bool isReused() const { return reused; }
+    // Close the connection instead of returning it to the pool, e.g. after a failed request
+    void discard();
+
+private:
+    ConnectionPool* pool;
+    std::unique_ptr<httplib::Client> connection;
+    bool reused;
+};
+
+// Keep-alive connections to a single host that are reused between REST calls.
+// The host is given as [scheme://]host[:port], without a scheme https is used.
+class ConnectionPool
+{
+public:
+    ConnectionPool(const std::string& host, int timeoutInSeconds,
+                   const ConnectionPoolSettings& settings = ConnectionPoolSettings());
+    ~ConnectionPool();
+
+    PooledConnection acquire();
+    ConnectionPoolStats getStats();
+    void clear();
+
+private:
+    typedef struct IdleConnection
+    {
+        std::unique_ptr<httplib::Client> client;
+        std::chrono::steady_clock::time_point lastUsed;
+    } IdleConnection;
+
+    friend class PooledConnection;
+    void release(std::unique_ptr<httplib::Client> client, bool reusable);
+    std::unique_ptr<httplib::Client> createConnection();
+    bool isReusable(const IdleConnection& connection, const std::chrono::steady_clock::time_point& now);
+
+    std::string host;
+    int timeout;
+    ConnectionPoolSettings settings;
+    std::list<IdleConnection> idleConnections;
+    ConnectionPoolStats stats;
+    std::mutex mutex;
+    std::condition_variable connectionReleased;
+};
+
+#endif // CONNECTIONPOOL_H
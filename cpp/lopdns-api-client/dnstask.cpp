@@ -0,0 +1,309 @@
+#include "nlohmann/json.hpp"
+#include "logging.h"
+
+#include "dnstask.h"
+#include "workerpool.h"
+#include <map>
+#include <algorithm>
+
+using json = nlohmann::json;
+
+const std::map<std::string, DnsTaskType> dnsTaskTypeMap = {
+    {"COPY_RECORD_CONTENT", DNSTASK_COPY_RECORD_CONTENT},
+    {"UPDATE_RECORD_CONTENT_STATIC", DNSTASK_UPDATE_RECORD_CONTENT_STATIC},
+    {"UPDATE_RECORD_CONTENT_REGEX", DNSTASK_UPDATE_RECORD_CONTENT_REGEX}};
+
+static std::optional<RegExSearch> readRegExSearch(const json& data, const char* key)
+{
+    auto it = data.find(key);
+    if (it == data.end() || it->is_null()) {
+        return std::nullopt;
+    }
+    RegExSearch search;
+    search.pattern = it->value("pattern", "");
+    search.group = it->value("group", 0);
+    return search;
+}
+
+static DnsTaskRecord readDnsTaskRecord(const json& data)
+{
+    DnsTaskRecord record;
+    record.name = data.value("name", "");
+    record.type = data.value("type", "");
+    record.contentMatchRegEx = readRegExSearch(data, "contentMatchRegEx");
+    record.contentDataExtractRegEx = readRegExSearch(data, "contentDataExtractRegEx");
+    record.contentReplaceRegEx = readRegExSearch(data, "contentReplaceRegEx");
+    return record;
+}
+
+std::vector<DnsTask> readDnsTasks(std::istream& input)
+{
+    json data;
+    try
+    {
+        data = json::parse(input);
+    }
+    catch (const json::exception& e)
+    {
+        throw std::runtime_error(std::string("invalid config file: ") + e.what());
+    }
+    auto tasksIt = data.find("dnsTasks");
+    if (!data.is_object() || tasksIt == data.end() || !tasksIt->is_array()) {
+        throw std::runtime_error("invalid config file: expected an object with a 'dnsTasks' array");
+    }
+
+    std::vector<DnsTask> tasks;
+    tasks.reserve(tasksIt->size());
+    for (const auto& item : *tasksIt) {
+        std::string position = "dnsTasks[" + std::to_string(tasks.size()) + "]";
+        try
+        {
+            DnsTask task;
+            task.zone = item.value("zone", "");
+            task.taskTypeName = item.value("taskType", "COPY_RECORD_CONTENT");
+            auto typeIt = dnsTaskTypeMap.find(task.taskTypeName);
+            if (typeIt == dnsTaskTypeMap.end()) {
+                throw std::runtime_error("invalid taskType '" + task.taskTypeName + "'");
+            }
+            task.taskType = typeIt->second;
+            task.dryRun = item.value("dryRun", false);
+            if (item.contains("sourceRecord") && !item["sourceRecord"].is_null()) {
+                task.sourceRecord = readDnsTaskRecord(item["sourceRecord"]);
+            }
+            if (!item.contains("targetRecord") || item["targetRecord"].is_null()) {
+                throw std::runtime_error("targetRecord is required");
+            }
+            task.targetRecord = readDnsTaskRecord(item["targetRecord"]);
+            if (task.zone.empty()) {
+                throw std::runtime_error("zone is required");
+            }
+            if (task.taskType != DNSTASK_UPDATE_RECORD_CONTENT_STATIC && !task.sourceRecord.has_value()) {
+                throw std::runtime_error("sourceRecord is required for " + task.taskTypeName);
+            }
+            tasks.push_back(task);
+        }
+        catch (const std::exception& e)
+        {
+            throw std::runtime_error("invalid config file: " + position + ": " + e.what());
+        }
+    }
+    return tasks;
+}
+
+// Implementation for DnsTaskRunner
+
+DnsTaskRunner::DnsTaskRunner(LopDnsClient& client, const std::vector<DnsTask>& tasks,
+                             const std::string& staticContent, int concurrency)
+    : client(client)
+{
+    this->staticContent = staticContent;
+    this->concurrency = concurrency;
+    for (const auto& task : tasks) {
+        CompiledTask compiled;
+        compiled.task = task;
+        if (task.sourceRecord.has_value()) {
+            compiled.source = compile(task.sourceRecord.value());
+        }
+        compiled.target = compile(task.targetRecord);
+        this->tasks.push_back(std::move(compiled));
+    }
+}
+
+static std::optional<std::regex> compileRegEx(const std::optional<RegExSearch>& search)
+{
+    if (!search.has_value()) {
+        return std::nullopt;
+    }
+    try
+    {
+        return std::regex(search->pattern);
+    }
+    catch (const std::regex_error& e)
+    {
+        throw std::runtime_error("invalid regular expression '" + search->pattern + "': " + e.what());
+    }
+}
+
+DnsTaskRunner::CompiledRecord DnsTaskRunner::compile(const DnsTaskRecord& record)
+{
+    CompiledRecord compiled;
+    compiled.contentMatch = compileRegEx(record.contentMatchRegEx);
+    compiled.contentDataExtract = compileRegEx(record.contentDataExtractRegEx);
+    compiled.contentReplace = compileRegEx(record.contentReplaceRegEx);
+    return compiled;
+}
+
+// Returns the group of the first match of the expression, empty if there is no match
+static std::string searchGroup(const std::regex& expression, int group, const std::string& content)
+{
+    std::smatch match;
+    if (!std::regex_search(content, match, expression) || group < 0 || static_cast<size_t>(group) >= match.size()) {
+        return "";
+    }
+    return match[group].str();
+}
+
+const Record* DnsTaskRunner::findRecord(const DnsTaskRecord& spec, const CompiledRecord& compiled, const ZoneIndex& records,
+                                        Record& found)
+{
+    for (const auto& record : records.find(spec.name, spec.type)) {
+        if (!compiled.contentMatch.has_value()
+            || !searchGroup(compiled.contentMatch.value(), spec.contentMatchRegEx->group, record.content).empty()) {
+            found = record;
+            return &found;
+        }
+    }
+    return nullptr;
+}
+
+std::string DnsTaskRunner::extractData(const DnsTaskRecord& spec, const CompiledRecord& compiled, const Record& record)
+{
+    if (compiled.contentDataExtract.has_value()) {
+        return searchGroup(compiled.contentDataExtract.value(), spec.contentDataExtractRegEx->group, record.content);
+    }
+    return record.content;
+}
+
+bool DnsTaskRunner::runTask(const CompiledTask& compiled, ZoneIndex& records, bool& updated,
+                            std::list<std::string>& messages)
+{
+    const DnsTask& task = compiled.task;
+    updated = false;
+
+    std::string sourceData;
+    bool sourceFound = false;
+    if (task.taskType == DNSTASK_UPDATE_RECORD_CONTENT_STATIC) {
+        if (staticContent.empty()) {
+            messages.push_back("Static content must be provided for UPDATE_RECORD_CONTENT_STATIC tasks.");
+            return false;
+        }
+        sourceData = staticContent;
+        sourceFound = true;
+    }
+
+    Record sourceRecord;
+    if (!sourceFound && findRecord(task.sourceRecord.value(), compiled.source, records, sourceRecord) != nullptr) {
+        sourceData = extractData(task.sourceRecord.value(), compiled.source, sourceRecord);
+        sourceFound = true;
+    }
+    Record targetRecord;
+    const Record* target = findRecord(task.targetRecord, compiled.target, records, targetRecord);
+
+    if (!sourceFound) {
+        messages.push_back("Could not find source record in zone " + task.zone + ".");
+        return false;
+    }
+    if (target == nullptr) {
+        messages.push_back("Could not find target record " + task.targetRecord.name + " (" + task.targetRecord.type
+                           + ") in zone " + task.zone + ".");
+        return false;
+    }
+    std::string targetData = extractData(task.targetRecord, compiled.target, *target);
+    if (targetData.empty()) {
+        messages.push_back("Could not find the data within the target record " + task.targetRecord.name + ".");
+        return false;
+    }
+    if (targetData == sourceData) {
+        LOG_DEBUG << "Data of " << task.targetRecord.name << " (" << task.targetRecord.type << ") is up to date.";
+        return true;
+    }
+
+    std::string newContent = sourceData;
+    if (compiled.target.contentReplace.has_value()) {
+        newContent = std::regex_replace(target->content, compiled.target.contentReplace.value(), sourceData);
+    }
+    std::string oldContent = target->content;
+    if (task.dryRun) {
+        messages.push_back("[Dry run] Record with name '" + task.targetRecord.name + "' of type '" + task.targetRecord.type
+                           + "' and old content '" + oldContent + "' in zone '" + task.zone
+                           + "' updated with new content '" + newContent + "'");
+        return true;
+    }
+    Record result = client.updateRecord(task.zone, target->name, target->type, oldContent,
+                                        std::nullopt, std::nullopt, newContent, std::nullopt, std::nullopt);
+    if (result.name.empty()) {
+        messages.push_back("Failed to update record " + task.targetRecord.name + " (" + task.targetRecord.type
+                           + ") in zone " + task.zone + ".");
+        return false;
+    }
+    // Later tasks on the zone work on the updated record
+    records.update(targetRecord.name, targetRecord.type, oldContent, result);
+    updated = true;
+    messages.push_back("Record with name '" + task.targetRecord.name + "' of type '" + task.targetRecord.type
+                       + "' and old content '" + oldContent + "' in zone '" + task.zone
+                       + "' updated with new content '" + newContent + "'.");
+    return true;
+}
+
+DnsTaskCycleStats DnsTaskRunner::runCycle()
+{
+    DnsTaskCycleStats stats;
+    std::vector<std::string> available = client.getZones();
+
+    // Tasks grouped by zone in config order, each zone is fetched once
+    std::vector<std::string> zones;
+    std::map<std::string, std::vector<const CompiledTask*>> zoneTasks;
+    for (const auto& compiled : tasks) {
+        const std::string& zone = compiled.task.zone;
+        if (std::find(available.begin(), available.end(), zone) == available.end()) {
+            LOG_ERROR << "Zone " << zone << " not found in account.";
+            stats.failed++;
+            continue;
+        }
+        auto& entry = zoneTasks[zone];
+        if (entry.empty()) {
+            zones.push_back(zone);
+        }
+        entry.push_back(&compiled);
+    }
+    stats.zonesFetched = static_cast<int>(zones.size());
+
+    struct ZoneOutcome
+    {
+        int updated = 0;
+        int unchanged = 0;
+        int failed = 0;
+        std::list<std::string> messages;
+        std::list<std::string> errors;
+    };
+    auto outcomes = parallelMap(zones, concurrency, [this, &zoneTasks](const std::string& zone) {
+        ZoneOutcome outcome;
+        std::vector<Record> fetched;
+        if (!client.getRecords(zone, fetched)) {
+            // Without the records every task would report its records as not found
+            outcome.failed = static_cast<int>(zoneTasks.at(zone).size());
+            outcome.errors.push_back("Failed to fetch the records of zone " + zone + ".");
+            return outcome;
+        }
+        ZoneIndex records(fetched);
+        for (const CompiledTask* compiled : zoneTasks.at(zone)) {
+            bool updated = false;
+            std::list<std::string> messages;
+            if (!runTask(*compiled, records, updated, messages)) {
+                outcome.failed++;
+                outcome.errors.splice(outcome.errors.end(), messages);
+                continue;
+            }
+            if (updated) {
+                outcome.updated++;
+            } else {
+                outcome.unchanged++;
+            }
+            outcome.messages.splice(outcome.messages.end(), messages);
+        }
+        return outcome;
+    });
+
+    for (const auto& outcome : outcomes) {
+        for (const auto& message : outcome.messages) {
+            LOG_INFO << message;
+        }
+        for (const auto& error : outcome.errors) {
+            LOG_ERROR << error;
+        }
+        stats.updated += outcome.updated;
+        stats.unchanged += outcome.unchanged;
+        stats.failed += outcome.failed;
+    }
+    return stats;
+}
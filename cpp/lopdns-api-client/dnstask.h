@@ -0,0 +1,103 @@
+#ifndef DNSTASK_H
+#define DNSTASK_H
+
+#include <string>
+#include <list>
+#include <vector>
+#include <optional>
+#include <istream>
+#include <regex>
+#include "lopdnsclient.h"
+#include "zoneindex.h"
+
+typedef enum DnsTaskType {
+    DNSTASK_COPY_RECORD_CONTENT,
+    DNSTASK_UPDATE_RECORD_CONTENT_STATIC,
+    DNSTASK_UPDATE_RECORD_CONTENT_REGEX
+} DnsTaskType;
+
+typedef struct RegExSearch
+{
+    std::string pattern;
+    int group = 0;
+} RegExSearch;
+
+typedef struct DnsTaskRecord
+{
+    std::string name;
+    std::string type;
+    // Only records whose content contains a match (of the group) are used
+    std::optional<RegExSearch> contentMatchRegEx;
+    // The data of the record that is compared and copied, the whole content without it
+    std::optional<RegExSearch> contentDataExtractRegEx;
+    // The part of the target content that is replaced by the source data, the whole content without it
+    std::optional<RegExSearch> contentReplaceRegEx;
+} DnsTaskRecord;
+
+// A task of the config.json file shared with the Python client, e.g.
+// {"zone": "example.com", "sourceRecord": {"name": "dyn.example.com", "type": "A"},
+//  "targetRecord": {"name": "example.com", "type": "MX"}, "taskType": "COPY_RECORD_CONTENT", "dryRun": true}
+typedef struct DnsTask
+{
+    std::string zone;
+    std::optional<DnsTaskRecord> sourceRecord;
+    DnsTaskRecord targetRecord;
+    DnsTaskType taskType = DNSTASK_COPY_RECORD_CONTENT;
+    std::string taskTypeName;
+    bool dryRun = false;
+} DnsTask;
+
+typedef struct DnsTaskCycleStats
+{
+    int zonesFetched = 0;
+    int updated = 0;
+    int unchanged = 0;
+    int failed = 0;
+} DnsTaskCycleStats;
+
+// Reads the dnsTasks of a config file, throws std::runtime_error if the file is invalid
+std::vector<DnsTask> readDnsTasks(std::istream& input);
+
+// Runs the tasks of a config file against the account of a client. Every cycle fetches the
+// zone list once and the records of each zone used by a task once; tasks on the same zone
+// share the records and see the updates made by the tasks before them.
+class DnsTaskRunner
+{
+public:
+    // Throws std::runtime_error if a regular expression of the tasks is invalid
+    DnsTaskRunner(LopDnsClient& client, const std::vector<DnsTask>& tasks,
+                  const std::string& staticContent = "", int concurrency = 4);
+
+    DnsTaskCycleStats runCycle();
+
+private:
+    // A task with its regular expressions compiled once
+    struct CompiledRecord
+    {
+        std::optional<std::regex> contentMatch;
+        std::optional<std::regex> contentDataExtract;
+        std::optional<std::regex> contentReplace;
+    };
+    struct CompiledTask
+    {
+        DnsTask task;
+        CompiledRecord source;
+        CompiledRecord target;
+    };
+
+    static CompiledRecord compile(const DnsTaskRecord& record);
+    // The first record of the zone that matches the spec
+    static const Record* findRecord(const DnsTaskRecord& spec, const CompiledRecord& compiled, const ZoneIndex& records,
+                                    Record& found);
+    static std::string extractData(const DnsTaskRecord& spec, const CompiledRecord& compiled, const Record& record);
+    // Returns false if the task failed, the outcome is appended to the messages
+    bool runTask(const CompiledTask& compiled, ZoneIndex& records, bool& updated,
+                 std::list<std::string>& messages);
+
+    LopDnsClient& client;
+    std::vector<CompiledTask> tasks;
+    std::string staticContent;
+    int concurrency;
+};
+
+#endif // DNSTASK_H
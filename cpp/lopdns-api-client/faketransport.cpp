@@ -0,0 +1,28 @@
+#include "faketransport.h"
+#include <algorithm>
+
+// Streamed bodies are handed out in pieces of this size, like a socket read would
+constexpr size_t streamChunkSize = 16 * 1024;
+
+FakeTransport::FakeTransport(const SimulationSettings& settings)
+    : simulation(settings)
+{
+}
+
+TransportResult FakeTransport::send(const TransportRequest& request)
+{
+    // There is no connection to set up, every request counts as sent on a reused one
+    TransportResult result;
+    result.reusedConnection = true;
+    result.response = simulation.handle(request.method, request.uri, request.headers, request.queryParams, request.body);
+    if (request.bodyReceiver && result.response.code >= 200 && result.response.code < 300) {
+        const std::string& body = result.response.body;
+        for (size_t offset = 0; offset < body.size(); offset += streamChunkSize) {
+            if (!request.bodyReceiver(body.data() + offset, std::min(streamChunkSize, body.size() - offset))) {
+                break;
+            }
+        }
+        result.response.body.clear();
+    }
+    return result;
+}
@@ -0,0 +1,25 @@
+#ifndef FAKETRANSPORT_H
+#define FAKETRANSPORT_H
+
+#include <string>
+#include "transport.h"
+#include "apisimulation.h"
+
+// Answers the requests of a LopDnsClient in-process from a LopDnsApiSimulation, without
+// sockets, TLS or HTTP parsing. Meant for measuring the parsing, selection and batching code
+// without network noise, the simulated latency is the only delay.
+class FakeTransport : public Transport
+{
+public:
+    explicit FakeTransport(const SimulationSettings& settings = SimulationSettings());
+
+    TransportResult send(const TransportRequest& request) override;
+    std::string describe() const override { return "fake://lopdns"; }
+
+    LopDnsApiSimulation& getSimulation() { return simulation; }
+
+private:
+    LopDnsApiSimulation simulation;
+};
+
+#endif // FAKETRANSPORT_H
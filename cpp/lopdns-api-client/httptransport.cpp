@@ -0,0 +1,187 @@
+#include "logging.h"
+#include "metrics.h"
+
+#include "httptransport.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+// Upper bound of the buffer reserved up front from a Content-Length header
+constexpr size_t maxReservedBodyLength = 64 * 1024 * 1024;
+
+HttpTransport::HttpTransport(const std::string& host, int timeoutInSeconds, const ConnectionPoolSettings& poolSettings)
+    : pool(host, timeoutInSeconds, poolSettings)
+{
+    this->host = host;
+    this->settings = poolSettings;
+}
+
+TransportResult HttpTransport::send(const TransportRequest& request)
+{
+    TransportResult result;
+    auto acquireStart = std::chrono::steady_clock::now();
+    httplib::Result httpResult;
+    PooledConnection connection = pool.acquire();
+    httplib::Client& client = connection.client();
+    result.connectionWaitSeconds = secondsSince(acquireStart);
+    result.reusedConnection = connection.isReused();
+
+    const std::string& method = request.method;
+    const std::string& uri = request.uri;
+    auto requestStart = std::chrono::steady_clock::now();
+    std::string receivedBody;
+    long long wireBytes = 0;
+    // Set for 2xx responses if the request has a body receiver
+    bool streamBody = false;
+    bool receiverStopped = false;
+    int streamedStatus = 0;
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    std::unique_ptr<StreamingDecoder> decoder;
+    bool decodeFailed = false;
+#endif
+
+    try
+    {
+        LOG_DEBUG << "Preparing HTTP " << method << " request to '" << client.host() << uri << "' on port " << client.port()
+                  << (connection.isReused() ? " (reused connection)" : " (new connection)");
+        httplib::Headers httpHeaders;
+        for (const auto& header : request.headers) {
+            httpHeaders.insert(header);
+        }
+        std::string compressedBody;
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+        if (settings.compressRequestsFromBytes > 0 && request.body.size() >= settings.compressRequestsFromBytes
+            && gzipCompress(request.body, compressedBody)) {
+            httpHeaders.insert({"Content-Encoding", "gzip"});
+            LOG_DEBUG << "Compressed the request body from " << request.body.size() << " to " << compressedBody.size() << " bytes.";
+        } else {
+            compressedBody.clear();
+        }
+#endif
+        const std::string& body = compressedBody.empty() ? request.body : compressedBody;
+        // Only the list responses are large enough to be worth it. Other responses are not decoded,
+        // so they are asked for unencoded explicitly since httplib may offer gzip on its own.
+        if (method == "GET" && settings.compressResponses && !supportedContentEncodings().empty()) {
+            httpHeaders.insert({"Accept-Encoding", supportedContentEncodings()});
+        } else {
+            httpHeaders.insert({"Accept-Encoding", "identity"});
+        }
+
+        httplib::Params httpParams;
+        for (const auto& param : request.queryParams) {
+            httpParams.insert(param);
+        }
+
+        if (method == "GET") {
+            // The response handler runs once the headers are read, the body is then received into a
+            // buffer sized from Content-Length and moved into the Response, or handed to the
+            // body receiver of the request
+            httpResult = client.Get(uri, httpParams, httpHeaders,
+                [&](const httplib::Response& headerResponse) {
+                    result.firstByteSeconds = secondsSince(requestStart);
+                    streamedStatus = headerResponse.status;
+                    streamBody = request.bodyReceiver && headerResponse.status >= 200 && headerResponse.status < 300;
+                    auto contentEncoding = headerResponse.get_header_value("Content-Encoding");
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+                    if (contentEncoding == "gzip" || contentEncoding == "deflate") {
+                        decoder = std::make_unique<StreamingDecoder>(contentEncoding, receivedBody);
+                    }
+#endif
+                    auto contentLength = headerResponse.get_header_value("Content-Length");
+                    // The length of an encoded body says little about the decoded size
+                    if (!contentLength.empty() && contentEncoding.empty() && !streamBody) {
+                        try
+                        {
+                            receivedBody.reserve(std::min<size_t>(std::stoull(contentLength), maxReservedBodyLength));
+                        }
+                        catch (const std::exception&)
+                        {
+                        }
+                    }
+                    return true;
+                },
+                [&](const char* data, size_t length) {
+                    wireBytes += static_cast<long long>(length);
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+                    // Decoded as it arrives, so the decoded body is complete when the last chunk is in
+                    if (decoder) {
+                        decodeFailed = !decoder->write(data, length);
+                        if (decodeFailed) {
+                            return false;
+                        }
+                        if (!streamBody || receivedBody.empty()) {
+                            return true;
+                        }
+                        receiverStopped = !request.bodyReceiver(receivedBody.data(), receivedBody.size());
+                        receivedBody.clear();
+                        return !receiverStopped;
+                    }
+#endif
+                    if (streamBody) {
+                        receiverStopped = !request.bodyReceiver(data, length);
+                        return !receiverStopped;
+                    }
+                    receivedBody.append(data, length);
+                    return true;
+                });
+        } else if (method == "POST") {
+            httpResult = body.empty() ? client.Post(uri, httpHeaders, httpParams) : client.Post(uri, httpHeaders, body, request.contentType);
+        } else if (method == "PUT") {
+            httpResult = body.empty() ? client.Put(uri, httpHeaders, httpParams) : client.Put(uri, httpHeaders, body, request.contentType);
+        } else if (method == "PATCH") {
+            httpResult = body.empty() ? client.Patch(uri, httpHeaders, httpParams) : client.Patch(uri, httpHeaders, body, request.contentType);
+        } else if (method == "DELETE") {
+            httpResult = body.empty() ? client.Delete(uri, httpHeaders, httpParams) : client.Delete(uri, httpHeaders, body, request.contentType);
+        } else {
+            throw std::runtime_error("Unsupported HTTP method: " + method);
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        connection.discard();
+        throw;
+    }
+
+    result.response.code = -1;
+    if (receiverStopped) {
+        // The rest of the body is still on the connection
+        connection.discard();
+        result.response.code = streamedStatus;
+        result.wireBytes = wireBytes;
+        return result;
+    }
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    // A 304 or an empty body has no compressed stream to end
+    if (decoder && httpResult && !decodeFailed && wireBytes > 0 && !decoder->finish()) {
+        decodeFailed = true;
+    }
+    if (decodeFailed) {
+        LOG_ERROR << "Failed to decode the " << (httpResult ? httpResult->get_header_value("Content-Encoding") : "")
+                  << " encoded response body.";
+        connection.discard();
+        result.response.body = "invalid compressed response";
+        return result;
+    }
+#endif
+    if (!httpResult) {
+        auto err = httplib::to_string(httpResult.error());
+        LOG_ERROR << "HTTP request failed: " << err;
+        auto sslResult = client.get_openssl_verify_result();
+        if (sslResult) {
+            LOG_ERROR << "SSL verify error: " << X509_verify_cert_error_string(sslResult);
+        }
+        connection.discard();
+        result.response.body = err;
+        return result;
+    }
+
+    result.response.code = httpResult->status;
+    result.response.body = method == "GET" ? std::move(receivedBody) : std::move(httpResult->body);
+    result.wireBytes = method == "GET" ? wireBytes : static_cast<long long>(result.response.body.size());
+    for (const auto& header : httpResult->headers) {
+        result.response.headers.insert(header);
+    }
+    return result;
+}
@@ -0,0 +1,28 @@
+#ifndef HTTPTRANSPORT_H
+#define HTTPTRANSPORT_H
+
+#include <string>
+#include "transport.h"
+#include "connectionpool.h"
+#include "compression.h"
+
+// The default transport, sends the requests with cpp-httplib over a pool of keep-alive
+// connections to one host
+class HttpTransport : public Transport
+{
+public:
+    // host is given as [scheme://]host[:port], see ConnectionPool
+    HttpTransport(const std::string& host, int timeoutInSeconds,
+                  const ConnectionPoolSettings& poolSettings = ConnectionPoolSettings());
+
+    TransportResult send(const TransportRequest& request) override;
+    std::string describe() const override { return host; }
+    ConnectionPoolStats getConnectionPoolStats() override { return pool.getStats(); }
+
+private:
+    std::string host;
+    ConnectionPoolSettings settings;
+    ConnectionPool pool;
+};
+
+#endif // HTTPTRANSPORT_H
@@ -0,0 +1,20 @@
+#include "logging.h"
+
+std::string truncateForLog(const std::string& text, size_t maxLength)
+{
+    if (text.size() <= maxLength) {
+        return text;
+    }
+    return text.substr(0, maxLength) + "... (" + std::to_string(text.size() - maxLength) + " more bytes)";
+}
+
+std::string redactSecret(const std::string& secret)
+{
+    if (secret.empty()) {
+        return "";
+    }
+    if (secret.size() < 16) {
+        return "<redacted>";
+    }
+    return secret.substr(0, 4) + "...<redacted>";
+}
@@ -0,0 +1,40 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <string>
+#include "plog/Log.h"
+
+// Lowest severity compiled into the binary, as plog::Severity value (2 error, 3 warning, 4 info,
+// 5 debug, 6 verbose). Less severe LOG_* statements are removed by the compiler together with the
+// formatting of their arguments, e.g. `make MIN_LOG_LEVEL=4` builds without debug logging.
+#ifndef LOPDNS_MIN_LOG_LEVEL
+#define LOPDNS_MIN_LOG_LEVEL 6
+#endif
+
+#if LOPDNS_MIN_LOG_LEVEL < 6
+#undef LOG_VERBOSE
+#define LOG_VERBOSE if (true) {;} else PLOG_VERBOSE
+#endif
+#if LOPDNS_MIN_LOG_LEVEL < 5
+#undef LOG_DEBUG
+#define LOG_DEBUG if (true) {;} else PLOG_DEBUG
+#endif
+#if LOPDNS_MIN_LOG_LEVEL < 4
+#undef LOG_INFO
+#define LOG_INFO if (true) {;} else PLOG_INFO
+#endif
+
+// True if messages of the severity are compiled in and enabled at runtime. Guards formatting
+// that is done before a LOG_* statement, e.g. in a std::stringstream.
+inline bool isLogEnabled(plog::Severity severity)
+{
+    return static_cast<int>(severity) <= LOPDNS_MIN_LOG_LEVEL && plog::get() != nullptr
+           && plog::get()->checkSeverity(severity);
+}
+
+// Cuts text after maxLength bytes and notes how many bytes were left out
+std::string truncateForLog(const std::string& text, size_t maxLength = 1024);
+// Hides a secret, only the first characters of long secrets are kept to correlate log lines
+std::string redactSecret(const std::string& secret);
+
+#endif // LOGGING_H
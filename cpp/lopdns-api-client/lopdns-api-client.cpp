@@ -4,6 +4,7 @@
 //
 
 #include <iostream>
+#include <fstream>
 #include <istream>
 #include <ostream>
 #include <string>
@@ -14,12 +15,27 @@
 #include <exception>
 #include <optional>
 #include <sstream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <csignal>
 #include "args.hxx"
-#include "plog/Log.h"
+#include "logging.h"
 #include "plog/Init.h"
 #include "plog/Formatters/TxtFormatter.h"
 #include "plog/Appenders/ColorConsoleAppender.h"
 #include "lopdnsclient.h"
+#include "workerpool.h"
+#include "batch.h"
+#include "recordselector.h"
+#include "zoneindex.h"
+#include "tokenstore.h"
+#include "dnstask.h"
+#include "reconcile.h"
+#include "sessionmanager.h"
+#include "zonesnapshot.h"
+#include "zonefile.h"
+#include "addresswatcher.h"
 
 
 const std::string URL = "api.lopdns.se";
@@ -33,7 +49,15 @@ typedef enum ActionType {
     ACTION_CREATE_RECORD,
     ACTION_UPDATE_RECORD,
     ACTION_CREATE_OR_UPDATE_RECORD,
-    ACTION_DELETE_RECORD
+    ACTION_DELETE_RECORD,
+    ACTION_APPLY_BATCH,
+    ACTION_DAEMON,
+    ACTION_RECONCILE,
+    ACTION_SNAPSHOT,
+    ACTION_RESTORE_FROM_SNAPSHOT,
+    ACTION_EXPORT_ZONEFILE,
+    ACTION_IMPORT_ZONEFILE,
+    ACTION_WATCH_ADDRESS
 } ActionType;
 
 typedef enum LogLevelType {
@@ -49,7 +73,15 @@ const std::map<std::string, ActionType> actionMap = {
     {"create-record", ACTION_CREATE_RECORD},
     {"update-record", ACTION_UPDATE_RECORD},
     {"createorupdate-record", ACTION_CREATE_OR_UPDATE_RECORD},
-    {"delete-record", ACTION_DELETE_RECORD}};
+    {"delete-record", ACTION_DELETE_RECORD},
+    {"apply-batch", ACTION_APPLY_BATCH},
+    {"daemon", ACTION_DAEMON},
+    {"reconcile", ACTION_RECONCILE},
+    {"snapshot", ACTION_SNAPSHOT},
+    {"restore-from-snapshot", ACTION_RESTORE_FROM_SNAPSHOT},
+    {"export-zonefile", ACTION_EXPORT_ZONEFILE},
+    {"import-zonefile", ACTION_IMPORT_ZONEFILE},
+    {"watch-address", ACTION_WATCH_ADDRESS}};
 
 const std::map<std::string, LogLevelType> logLevelMap = {
     {"error", LOGLEVEL_ERROR},
@@ -63,13 +95,49 @@ struct Settings
     std::string base_url = URL;
     int timeout = 10;
     int token_duration_sec = 3600;
+    int token_refresh_margin_sec = 60;
+    bool token_store = false;
+    std::string token_store_dir;
+    bool keep_token = false;
+    int max_connections = 4;
+    int connection_idle_timeout_sec = 30;
+    bool compression = true;
+    int compress_requests_from_bytes = 0;
+    int concurrency = 4;
+    int max_attempts = 3;
+    int retry_base_delay_ms = 200;
+    int retry_max_delay_ms = 5000;
+    int record_cache_sec = 0;
     std::string client_id;
+    std::string credentials_file;
     ActionType action = ACTION_GET_ZONES;
     std::string zone;
     std::string record_name;
     std::string record_type;
     std::string current_record_content;
     std::string replace_record_content_regex;
+    std::string batch_file;
+    std::string desired_state_file;
+    std::string snapshot_file;
+    // get-records reads the snapshot file instead of the API
+    bool from_snapshot = false;
+    std::string zone_file;
+
+    // Daemon mode
+    std::string config_file = "config.json";
+    int interval_sec = 60;
+    bool once = false;
+    std::string static_content;
+
+    // Address watcher
+    std::string interface_name;
+    int debounce_ms = 2000;
+    std::string state_file;
+
+    // Metrics export
+    std::string metrics_file;
+    std::string metrics_address = "127.0.0.1";
+    int metrics_port = 0;
     
     // New content for create or update
     std::optional<std::string> new_record_content;
@@ -79,10 +147,37 @@ struct Settings
     std::optional<int> new_record_priority;
 
     bool all_records = false;
+    bool all_zones = false;
     LogLevelType log_level = LOGLEVEL_INFO;
     bool dry_run = false;
 };
 
+// Outcome of an action on a single zone, reported after all zones are processed
+// so that the output does not depend on the order in which the zones finish
+struct ZoneResult
+{
+    std::string zone;
+    int exitCode = 0;
+    std::string error;
+    int processedRecords = 0;
+    std::list<std::string> messages;
+};
+
+// Record selection compiled once per run from the settings and shared by all zones
+struct Selection
+{
+    RecordSelector selector;
+    std::optional<ContentReplacer> replacer;
+
+    explicit Selection(const Settings& settings)
+        : selector(settings.record_name, settings.record_type, settings.current_record_content)
+    {
+        if (!settings.replace_record_content_regex.empty() && settings.new_record_content.has_value()) {
+            replacer.emplace(settings.replace_record_content_regex, settings.new_record_content.value());
+        }
+    }
+};
+
 void trim(std::string& s) {
     auto not_space = [](unsigned char c){ return !std::isspace(c); };
 
@@ -92,25 +187,19 @@ void trim(std::string& s) {
     s.erase(std::find_if(s.rbegin(), s.rend(), not_space).base(), s.end());
 }
 
-std::list<Record> getRecords(LopDnsClient& client, const Settings& settings)
+// Returns false if the records could not be fetched or decoded, the matches are then incomplete
+bool getRecords(LopDnsClient& client, const Settings& settings, const Selection& selection, std::vector<Record>& selected)
 {
-    std::list<Record> matchedRecords;
-
-    auto records = client.getRecords(settings.zone);
-    for (const auto& record : records) {
-        std::cmatch regex_match;
-        if (record.name == settings.record_name && 
-            record.type == settings.record_type && 
-                ((settings.all_records && settings.current_record_content.empty()) || 
-                std::regex_search(record.content.c_str(), regex_match, std::regex(settings.current_record_content)))) {
-            matchedRecords.push_back(record);
+    // Only the matches are kept. Without --all the second match is enough to tell that there are several.
+    return client.forEachRecord(settings.zone, [&settings, &selection, &selected](const Record& record) {
+        if (selection.selector.matches(record)) {
+            selected.push_back(record);
         }
-    }
-
-    return matchedRecords;
+        return settings.all_records || selected.size() < 2;
+    });
 }
 
-bool createRecord(LopDnsClient& client, const Settings& settings, Record& outRecord)
+bool createRecord(LopDnsClient& client, const Settings& settings, Record& outRecord, std::list<std::string>& messages)
 {
     std::string contentValue;
     std::string nameValue;
@@ -135,7 +224,7 @@ bool createRecord(LopDnsClient& client, const Settings& settings, Record& outRec
     int ttlValue = settings.new_record_ttl.value_or(defaultDnsRecordTtl);
     int priorityValue = settings.new_record_priority.value_or(defaultDnsRecordPriority);
     if (settings.dry_run) {
-        LOG_INFO << "[Dry Run] Would create record:" << std::endl;
+        messages.push_back("[Dry Run] Would create record:");
         outRecord.name = nameValue;
         outRecord.type = typeValue;
         outRecord.content = contentValue;
@@ -149,7 +238,6 @@ bool createRecord(LopDnsClient& client, const Settings& settings, Record& outRec
                                                 ttlValue,
                                                 priorityValue);
         if (outRecord.name.empty()) {
-            LOG_ERROR << "Failed to create record.";
             return false;
         }
     }
@@ -159,13 +247,13 @@ bool createRecord(LopDnsClient& client, const Settings& settings, Record& outRec
     logData << "  Name: " << outRecord.name << ", Type: " << outRecord.type
                 << ", Content: " << outRecord.content << ", TTL: " << outRecord.ttl
                 << ", Priority: " << outRecord.priority << std::endl;
-    LOG_INFO << logData.str();
+    messages.push_back(logData.str());
 
     return true;
 }
 
 bool updateRecord(LopDnsClient& client, const Settings& settings, const Record& record, 
-    const std::optional<std::string>& new_record_content, Record& outRecord)
+    const std::optional<std::string>& new_record_content, Record& outRecord, std::list<std::string>& messages)
 {
     std::stringstream logData;
     if (settings.dry_run) {
@@ -199,7 +287,6 @@ bool updateRecord(LopDnsClient& client, const Settings& settings, const Record&
             settings.new_record_ttl,
             settings.new_record_priority);
         if (outRecord.name.empty()) {
-            LOG_ERROR << "Failed to update record.";
             return false;
         }
 
@@ -222,26 +309,25 @@ bool updateRecord(LopDnsClient& client, const Settings& settings, const Record&
         logData << "  Priority: " << outRecord.priority << " (was '" << record.priority << "')" << std::endl;
     }
 
-    LOG_INFO << logData.str();
+    messages.push_back(logData.str());
 
     return true;
 }
 
 
-bool deleteRecord(LopDnsClient& client, const Settings& settings, const Record& record)
+bool deleteRecord(LopDnsClient& client, const Settings& settings, const Record& record, std::list<std::string>& messages)
 {
     if (settings.dry_run) {
         std::stringstream logData;
         logData << "[Dry Run] Would delete record:" << std::endl;
         logData << "  Name: " << record.name << ", Type: " << record.type
                   << ", Content: " << record.content << std::endl;
-        LOG_INFO << logData.str();
+        messages.push_back(logData.str());
         return true;
     }
     
     bool success = client.deleteRecord(settings.zone, record.name, record.type, record.content);
     if (!success) {
-        LOG_ERROR << "Failed to delete record.";
         return false;
     }
 
@@ -249,11 +335,98 @@ bool deleteRecord(LopDnsClient& client, const Settings& settings, const Record&
     logData << "Record deleted:" << std::endl;
     logData << "  Name: " << record.name << ", Type: " << record.type
                 << ", Content: " << record.content << std::endl;
-    LOG_INFO << logData.str();
+    messages.push_back(logData.str());
 
     return true;
 }
 
+ZoneResult updateRecordsInZone(LopDnsClient& client, const Settings& settings, const Selection& selection)
+{
+    ZoneResult result;
+    result.zone = settings.zone;
+
+    std::vector<Record> records;
+    if (!getRecords(client, settings, selection, records)) {
+        // Without the records a create-or-update would add a duplicate
+        result.exitCode = 21;
+        result.error = "Failed to fetch records.";
+        return result;
+    }
+    for (const auto& record : records) {
+        std::optional<std::string> new_content;
+        if (selection.replacer.has_value()) {
+            new_content = selection.replacer->replace(record.content);
+        }
+        else if (settings.new_record_content.has_value()) {
+            new_content = settings.new_record_content;
+        }
+
+        Record updatedRecord;
+        if (!updateRecord(client, settings, record, new_content, updatedRecord, result.messages)) {
+            result.exitCode = 5;
+            result.error = "Failed to update record.";
+            return result;
+        }
+        result.processedRecords++;
+
+        if (!settings.all_records) {
+            break;
+        }
+    }
+    if (result.processedRecords == 0 && settings.action == ACTION_CREATE_OR_UPDATE_RECORD) {
+        result.messages.push_back("No matching records found. Creating new record.");
+        Record newRecord;
+        if (!createRecord(client, settings, newRecord, result.messages)) {
+            result.exitCode = 4;
+            result.error = "Failed to create record.";
+        }
+    }
+    return result;
+}
+
+ZoneResult deleteRecordsInZone(LopDnsClient& client, const Settings& settings, const Selection& selection)
+{
+    ZoneResult result;
+    result.zone = settings.zone;
+
+    std::vector<Record> records;
+    if (!getRecords(client, settings, selection, records)) {
+        result.exitCode = 21;
+        result.error = "Failed to fetch records.";
+        return result;
+    }
+    for (const auto& record : records) {
+        if (!deleteRecord(client, settings, record, result.messages)) {
+            result.exitCode = 8;
+            result.error = "Failed to delete record.";
+            return result;
+        }
+        result.processedRecords++;
+        if (!settings.all_records) {
+            if (records.size() > 1) {
+                result.messages.push_back("Multiple matching records found, but 'all_records' flag is not set. Stopping after first deletion.");
+            }
+            break;
+        }
+    }
+    return result;
+}
+
+// The client a zone is processed with, the single client or the one of the owning account
+typedef std::function<LopDnsClient&(const std::string& zone)> ClientForZone;
+
+// Runs the action for every zone on the worker pool and returns the results in zone order
+std::vector<ZoneResult> runOnZones(const ClientForZone& clientForZone, const Settings& settings, const std::vector<std::string>& zones,
+    ZoneResult (*action)(LopDnsClient&, const Settings&, const Selection&))
+{
+    Selection selection(settings);
+    return parallelMap(zones, settings.concurrency, [&clientForZone, &settings, &selection, action](const std::string& zone) {
+        Settings zoneSettings = settings;
+        zoneSettings.zone = zone;
+        return action(clientForZone(zone), zoneSettings, selection);
+    });
+}
+
 bool handleArgs(int argc, char* argv[], Settings& settings)
 {
     std::string actionMsg = "The action to perform. Valid actions are: ";
@@ -265,7 +438,19 @@ bool handleArgs(int argc, char* argv[], Settings& settings)
     args::ValueFlag<std::string> base_url(parser, "base_url", "The base URL for the API", {'b', "base-url"}, URL);
     args::ValueFlag<int> timeout(parser, "timeout", "The timeout for the API requests", {'t', "timeout"}, 10);
     args::ValueFlag<int> token_duration_sec(parser, "token_duration_sec", "The token duration in seconds", {'d', "token-duration-sec"}, 3600);
+    args::ValueFlag<int> token_refresh_margin_sec(parser, "token_refresh_margin_sec", "The token is refreshed when it expires within this many seconds", {"token-refresh-margin-sec"}, 60);
+    args::Flag token_store(parser, "token_store", "Flag to reuse the token between runs, it is stored in a file per client ID", {"token-store"}, false);
+    args::ValueFlag<std::string> token_store_dir(parser, "token_store_dir", "The directory of the token store (default $XDG_CACHE_HOME/lopdns-api-client or ~/.cache/lopdns-api-client)", {"token-store-dir"}, "");
+    args::Flag keep_token(parser, "keep_token", "Flag to keep the token valid when exiting on an error instead of invalidating it (implied by --token-store)", {"keep-token"}, false);
+    args::ValueFlag<int> max_connections(parser, "max_connections", "The maximum number of keep-alive connections to the API", {"max-connections"}, 4);
+    args::ValueFlag<int> connection_idle_timeout_sec(parser, "connection_idle_timeout_sec", "Idle time in seconds after which a keep-alive connection is closed", {"connection-idle-timeout-sec"}, 30);
+    args::Flag no_compression(parser, "no_compression", "Do not ask the API for gzip or deflate encoded responses", {"no-compression"});
+    args::ValueFlag<int> compress_requests_from_bytes(parser, "compress_requests_from_bytes", "Send request bodies of at least this many bytes gzip encoded, 0 disables it", {"compress-requests-from-bytes"}, 0);
+    args::ValueFlag<int> max_attempts(parser, "max_attempts", "Attempts per request, GET is retried on connection errors, 5xx and 429, PUT and DELETE on connection errors (1 disables retries)", {"max-attempts"}, 3);
+    args::ValueFlag<int> retry_base_delay_ms(parser, "retry_base_delay_ms", "Base delay in milliseconds of the exponential backoff between attempts", {"retry-base-delay-ms"}, 200);
+    args::ValueFlag<int> retry_max_delay_ms(parser, "retry_max_delay_ms", "Maximum delay in milliseconds between attempts", {"retry-max-delay-ms"}, 5000);
     args::ValueFlag<std::string> client_id(parser, "client_id", "The client ID for authentication", {'c', "client-id"}, "");
+    args::ValueFlag<std::string> credentials_file(parser, "credentials_file", "JSON file with the client IDs of several accounts, used instead of --client-id. Zones are routed to the account that owns them", {"credentials-file"}, "");
     args::ValueFlag<std::string> zone(parser, "zone", "The DNS zone to update", {'z', "zone"}, "");
     args::ValueFlag<std::string> record_type(parser, "record_type", "The type of the DNS record", {'r', "record-type"}, "A");
     args::ValueFlag<std::string> record_name(parser, "record_name", "The name of the DNS record", {'n', "record-name"}, "");
@@ -276,8 +461,26 @@ bool handleArgs(int argc, char* argv[], Settings& settings)
     args::ValueFlag<std::string> new_record_name(parser, "new_record_name", "New record name to be updated with", {'N', "new-record-name"}, "");
     args::ValueFlag<int> new_record_ttl(parser, "new_record_ttl", "The new TTL for the DNS record", {'T', "new-record-ttl"}, 0);
     args::ValueFlag<int> new_record_priority(parser, "new_record_priority", "The new priority for the DNS record", {'p', "new-record-priority"}, 0);
+    args::ValueFlag<std::string> batch_file(parser, "batch_file", "NDJSON file with one record operation per line for apply-batch, '-' for stdin", {"batch-file"}, "");
+    args::ValueFlag<std::string> desired_state_file(parser, "desired_state_file", "JSON file with the desired records per zone for reconcile", {"desired-state-file"}, "");
+    args::ValueFlag<std::string> snapshot_file(parser, "snapshot_file", "Binary snapshot file written by snapshot and read by restore-from-snapshot", {"snapshot-file"}, "");
+    args::ValueFlag<std::string> from_snapshot(parser, "from_snapshot", "Snapshot file get-records reads the records from, without connecting to the API", {"from-snapshot"}, "");
+    args::ValueFlag<std::string> zone_file(parser, "zone_file", "RFC 1035 master file written by export-zonefile and read by import-zonefile, '-' for stdout or stdin", {"zone-file"}, "");
+    args::ValueFlag<std::string> config_file(parser, "config_file", "Config file with the dnsTasks run by the daemon action", {'f', "config-file"}, "config.json");
+    args::ValueFlag<int> interval_sec(parser, "interval_sec", "Seconds between two runs of the daemon tasks", {'i', "interval-sec"}, 60);
+    args::Flag once(parser, "once", "Flag to run the daemon tasks only once", {'o', "once"}, false);
+    args::ValueFlag<std::string> static_content(parser, "static_content", "Content for UPDATE_RECORD_CONTENT_STATIC tasks", {'s', "static-content"}, "");
+    args::ValueFlag<std::string> interface_name(parser, "interface_name", "Network interface whose address watch-address publishes", {"interface"}, "");
+    args::ValueFlag<int> debounce_ms(parser, "debounce_ms", "Milliseconds without further address changes before watch-address publishes", {"debounce-ms"}, 2000);
+    args::ValueFlag<std::string> state_file(parser, "state_file", "File in which watch-address keeps the last published address between runs", {"state-file"}, "");
+    args::ValueFlag<std::string> metrics_file(parser, "metrics_file", "File the request metrics are written to at the end of the run and after every daemon cycle (JSON if it ends with .json, Prometheus text otherwise)", {"metrics-file"}, "");
+    args::ValueFlag<int> metrics_port(parser, "metrics_port", "Port of the HTTP endpoint serving the request metrics on /metrics in daemon mode", {"metrics-port"}, 0);
+    args::ValueFlag<std::string> metrics_address(parser, "metrics_address", "Address of the metrics endpoint", {"metrics-address"}, "127.0.0.1");
     args::ValueFlag<std::string> action(parser, "action", "The action to perform", {'a', "action"}, "");
     args::Flag all_records(parser, "all_records", "Flag to indicate that all applicable records should be processed", {'A', "all-records"}, false);
+    args::Flag all_zones(parser, "all_zones", "Flag to indicate that update-record or delete-record should be applied to all zones", {"all-zones"}, false);
+    args::ValueFlag<int> record_cache_sec(parser, "record_cache_sec", "Cache zone records, revalidated with the server if it sends validators and otherwise reused for this many seconds (0 disables the cache)", {"record-cache-sec"}, 0);
+    args::ValueFlag<int> concurrency(parser, "concurrency", "The maximum number of zones processed in parallel", {"concurrency"}, 4);
     args::ValueFlag<std::string> log_level(parser, "log_level", "The logging level (error, warning, info, debug)", {'l', "log-level"}, "info");
     args::Flag dry_run(parser, "dry_run", "Flag to indicate that no changes should be made", {'D', "dry-run"}, false);
 
@@ -333,6 +536,13 @@ bool handleArgs(int argc, char* argv[], Settings& settings)
     if (all_records) {
         settings.all_records = args::get(all_records);
     }
+    if (concurrency) {
+        settings.concurrency = args::get(concurrency);
+        if (settings.concurrency < 1) {
+            LOG_ERROR << "Concurrency must be at least 1.";
+            return false;
+        }
+    }
     if (action) {
         std::string actionStr = args::get(action);
         trim(actionStr);
@@ -351,7 +561,47 @@ bool handleArgs(int argc, char* argv[], Settings& settings)
         LOG_ERROR << "Action is required.";
         return false;
     }
-    if (client_id) {
+    if (all_zones) {
+        settings.all_zones = args::get(all_zones);
+        if (settings.action != ACTION_UPDATE_RECORD && settings.action != ACTION_DELETE_RECORD) {
+            LOG_ERROR << "The all-zones flag can only be used with update-record and delete-record.";
+            return false;
+        }
+        if (zone) {
+            LOG_ERROR << "Zone and the all-zones flag cannot be combined.";
+            return false;
+        }
+    }
+    if (from_snapshot) {
+        std::string fromSnapshotStr = args::get(from_snapshot);
+        trim(fromSnapshotStr);
+        settings.snapshot_file = fromSnapshotStr;
+        settings.from_snapshot = true;
+        if (settings.action != ACTION_GET_RECORDS) {
+            LOG_ERROR << "Only get-records can read from a snapshot.";
+            return false;
+        }
+        if (snapshot_file) {
+            LOG_ERROR << "The snapshot file and from-snapshot cannot be combined.";
+            return false;
+        }
+    }
+    if (settings.from_snapshot) {
+        // No API access, so no credentials
+    } else if (credentials_file) {
+        std::string credentialsFileStr = args::get(credentials_file);
+        trim(credentialsFileStr);
+        settings.credentials_file = credentialsFileStr;
+        if (client_id) {
+            LOG_ERROR << "Client ID and the credentials file cannot be combined.";
+            return false;
+        }
+        if (settings.action == ACTION_APPLY_BATCH || settings.action == ACTION_DAEMON || settings.action == ACTION_IMPORT_ZONEFILE
+            || settings.action == ACTION_WATCH_ADDRESS) {
+            LOG_ERROR << "The credentials file cannot be used with apply-batch, import-zonefile, daemon and watch-address.";
+            return false;
+        }
+    } else if (client_id) {
         std::string clientIdStr = args::get(client_id);
         trim(clientIdStr);
         settings.client_id = clientIdStr;
@@ -368,6 +618,7 @@ bool handleArgs(int argc, char* argv[], Settings& settings)
         || settings.action == ACTION_CREATE_RECORD
         || settings.action == ACTION_CREATE_OR_UPDATE_RECORD
         || settings.action == ACTION_DELETE_RECORD
+        || settings.action == ACTION_WATCH_ADDRESS
         ) {
         LOG_ERROR << "Record type is required.";
         return false;
@@ -377,11 +628,14 @@ bool handleArgs(int argc, char* argv[], Settings& settings)
         trim(zoneStr);
         settings.zone = zoneStr;
     } else if (
-        settings.action == ACTION_UPDATE_RECORD
+        (settings.action == ACTION_UPDATE_RECORD && !settings.all_zones)
         || settings.action == ACTION_CREATE_RECORD
         || settings.action == ACTION_CREATE_OR_UPDATE_RECORD
-        || settings.action == ACTION_GET_RECORDS
-        || settings.action == ACTION_DELETE_RECORD
+        || (settings.action == ACTION_GET_RECORDS && !settings.from_snapshot)
+        || settings.action == ACTION_EXPORT_ZONEFILE
+        || settings.action == ACTION_IMPORT_ZONEFILE
+        || settings.action == ACTION_WATCH_ADDRESS
+        || (settings.action == ACTION_DELETE_RECORD && !settings.all_zones)
     ) {
         LOG_ERROR << "Zone is required.";
         return false;
@@ -395,6 +649,7 @@ bool handleArgs(int argc, char* argv[], Settings& settings)
         || settings.action == ACTION_CREATE_RECORD
         || settings.action == ACTION_CREATE_OR_UPDATE_RECORD
         || settings.action == ACTION_DELETE_RECORD
+        || settings.action == ACTION_WATCH_ADDRESS
         ) {
         LOG_ERROR << "Record name is required.";
         return false;
@@ -420,6 +675,95 @@ bool handleArgs(int argc, char* argv[], Settings& settings)
         LOG_ERROR << "New content is required.";
         return false;
     }
+    if (batch_file) {
+        std::string batchFileStr = args::get(batch_file);
+        trim(batchFileStr);
+        settings.batch_file = batchFileStr;
+    } else if (settings.action == ACTION_APPLY_BATCH) {
+        LOG_ERROR << "Batch file is required.";
+        return false;
+    }
+    if (desired_state_file) {
+        std::string desiredStateFileStr = args::get(desired_state_file);
+        trim(desiredStateFileStr);
+        settings.desired_state_file = desiredStateFileStr;
+    } else if (settings.action == ACTION_RECONCILE) {
+        LOG_ERROR << "Desired-state file is required.";
+        return false;
+    }
+    if (snapshot_file) {
+        std::string snapshotFileStr = args::get(snapshot_file);
+        trim(snapshotFileStr);
+        settings.snapshot_file = snapshotFileStr;
+    } else if (settings.action == ACTION_SNAPSHOT || settings.action == ACTION_RESTORE_FROM_SNAPSHOT) {
+        LOG_ERROR << "Snapshot file is required.";
+        return false;
+    }
+    if (zone_file) {
+        std::string zoneFileStr = args::get(zone_file);
+        trim(zoneFileStr);
+        settings.zone_file = zoneFileStr;
+    } else if (settings.action == ACTION_EXPORT_ZONEFILE || settings.action == ACTION_IMPORT_ZONEFILE) {
+        LOG_ERROR << "Zone file is required.";
+        return false;
+    }
+    if (config_file) {
+        std::string configFileStr = args::get(config_file);
+        trim(configFileStr);
+        settings.config_file = configFileStr;
+    }
+    if (interval_sec) {
+        settings.interval_sec = args::get(interval_sec);
+        if (settings.interval_sec < 1) {
+            LOG_ERROR << "Interval must be at least 1 second.";
+            return false;
+        }
+    }
+    if (once) {
+        settings.once = args::get(once);
+    }
+    if (static_content) {
+        std::string staticContentStr = args::get(static_content);
+        trim(staticContentStr);
+        settings.static_content = staticContentStr;
+    }
+    if (interface_name) {
+        std::string interfaceNameStr = args::get(interface_name);
+        trim(interfaceNameStr);
+        settings.interface_name = interfaceNameStr;
+    } else if (settings.action == ACTION_WATCH_ADDRESS) {
+        LOG_ERROR << "Interface is required.";
+        return false;
+    }
+    if (debounce_ms) {
+        settings.debounce_ms = args::get(debounce_ms);
+        if (settings.debounce_ms < 0) {
+            LOG_ERROR << "Debounce time cannot be negative.";
+            return false;
+        }
+    }
+    if (state_file) {
+        std::string stateFileStr = args::get(state_file);
+        trim(stateFileStr);
+        settings.state_file = stateFileStr;
+    }
+    if (metrics_file) {
+        std::string metricsFileStr = args::get(metrics_file);
+        trim(metricsFileStr);
+        settings.metrics_file = metricsFileStr;
+    }
+    if (metrics_port) {
+        settings.metrics_port = args::get(metrics_port);
+        if (settings.action != ACTION_DAEMON) {
+            LOG_ERROR << "The metrics endpoint can only be used with the daemon action.";
+            return false;
+        }
+    }
+    if (metrics_address) {
+        std::string metricsAddressStr = args::get(metrics_address);
+        trim(metricsAddressStr);
+        settings.metrics_address = metricsAddressStr;
+    }
     if (new_record_ttl) {
         settings.new_record_ttl = args::get(new_record_ttl);
     }
@@ -437,6 +781,53 @@ bool handleArgs(int argc, char* argv[], Settings& settings)
     if (token_duration_sec) {
         settings.token_duration_sec = args::get(token_duration_sec);
     }
+    if (record_cache_sec) {
+        settings.record_cache_sec = args::get(record_cache_sec);
+    }
+    if (token_refresh_margin_sec) {
+        settings.token_refresh_margin_sec = args::get(token_refresh_margin_sec);
+    }
+    if (token_store) {
+        settings.token_store = args::get(token_store);
+    }
+    if (token_store_dir) {
+        std::string tokenStoreDirStr = args::get(token_store_dir);
+        trim(tokenStoreDirStr);
+        settings.token_store_dir = tokenStoreDirStr;
+        settings.token_store = true;
+    }
+    if (keep_token) {
+        settings.keep_token = args::get(keep_token);
+    }
+    if (max_connections) {
+        settings.max_connections = args::get(max_connections);
+    }
+    if (max_attempts) {
+        settings.max_attempts = args::get(max_attempts);
+        if (settings.max_attempts < 1) {
+            LOG_ERROR << "Max attempts must be at least 1.";
+            return false;
+        }
+    }
+    if (retry_base_delay_ms) {
+        settings.retry_base_delay_ms = args::get(retry_base_delay_ms);
+    }
+    if (retry_max_delay_ms) {
+        settings.retry_max_delay_ms = args::get(retry_max_delay_ms);
+    }
+    if (connection_idle_timeout_sec) {
+        settings.connection_idle_timeout_sec = args::get(connection_idle_timeout_sec);
+    }
+    if (no_compression) {
+        settings.compression = false;
+    }
+    if (compress_requests_from_bytes) {
+        settings.compress_requests_from_bytes = args::get(compress_requests_from_bytes);
+        if (settings.compress_requests_from_bytes < 0) {
+            LOG_ERROR << "Compress requests from bytes must not be negative.";
+            return false;
+        }
+    }
     if (dry_run) {
         settings.dry_run = args::get(dry_run);
     }
@@ -449,7 +840,17 @@ void logSettings(const Settings& settings)
     LOG_DEBUG << "  Base URL: " << settings.base_url;
     LOG_DEBUG << "  Timeout: " << settings.timeout << " seconds";
     LOG_DEBUG << "  Token Duration: " << settings.token_duration_sec << " seconds";
-    LOG_DEBUG << "  Client ID: " << settings.client_id;
+    LOG_DEBUG << "  Token Refresh Margin: " << settings.token_refresh_margin_sec << " seconds";
+    LOG_DEBUG << "  Token Store: " << (settings.token_store ? "true" : "false") << " " << settings.token_store_dir;
+    LOG_DEBUG << "  Keep Token: " << (settings.keep_token ? "true" : "false");
+    LOG_DEBUG << "  Max Connections: " << settings.max_connections;
+    LOG_DEBUG << "  Connection Idle Timeout: " << settings.connection_idle_timeout_sec << " seconds";
+    LOG_DEBUG << "  Compression: " << (settings.compression ? "true" : "false")
+              << ", requests from " << settings.compress_requests_from_bytes << " bytes";
+    LOG_DEBUG << "  Max Attempts: " << settings.max_attempts;
+    LOG_DEBUG << "  Retry Delay: " << settings.retry_base_delay_ms << " - " << settings.retry_max_delay_ms << " ms";
+    LOG_DEBUG << "  Client ID: " << redactSecret(settings.client_id);
+    LOG_DEBUG << "  Credentials File: " << settings.credentials_file;
     LOG_DEBUG << "  Action: ";
     for (const auto& pair : actionMap) {
         if (pair.second == settings.action) {
@@ -462,6 +863,19 @@ void logSettings(const Settings& settings)
     LOG_DEBUG << "  Record Name: " << settings.record_name;
     LOG_DEBUG << "  Current Content: " << settings.current_record_content;
     LOG_DEBUG << "  Replace Content: " << settings.replace_record_content_regex;
+    LOG_DEBUG << "  Batch File: " << settings.batch_file;
+    LOG_DEBUG << "  Desired-State File: " << settings.desired_state_file;
+    LOG_DEBUG << "  Zone File: " << settings.zone_file;
+    LOG_DEBUG << "  Snapshot File: " << settings.snapshot_file << (settings.from_snapshot ? " (read)" : "");
+    LOG_DEBUG << "  Config File: " << settings.config_file;
+    LOG_DEBUG << "  Interval: " << settings.interval_sec << " seconds";
+    LOG_DEBUG << "  Once: " << (settings.once ? "true" : "false");
+    LOG_DEBUG << "  Static Content: " << settings.static_content;
+    LOG_DEBUG << "  Interface: " << settings.interface_name;
+    LOG_DEBUG << "  Debounce: " << settings.debounce_ms << " ms";
+    LOG_DEBUG << "  State File: " << settings.state_file;
+    LOG_DEBUG << "  Metrics File: " << settings.metrics_file;
+    LOG_DEBUG << "  Metrics Endpoint: " << settings.metrics_address << ":" << settings.metrics_port;
     if (settings.new_record_content.has_value()) {
         LOG_DEBUG << "  New Content: " << settings.new_record_content.value();
     } else {
@@ -478,6 +892,9 @@ void logSettings(const Settings& settings)
         LOG_DEBUG << "  Priority: (not set)";
     }
     LOG_DEBUG << "  All Records: " << (settings.all_records ? "true" : "false");
+    LOG_DEBUG << "  All Zones: " << (settings.all_zones ? "true" : "false");
+    LOG_DEBUG << "  Concurrency: " << settings.concurrency;
+    LOG_DEBUG << "  Record Cache: " << settings.record_cache_sec << " seconds";
     std::stringstream ll; 
     ll << "  Log Level: ";
     for (const auto& pair : logLevelMap) {
@@ -490,15 +907,740 @@ void logSettings(const Settings& settings)
     LOG_DEBUG << "  Dry Run: " << (settings.dry_run ? "true" : "false");
 }
 
+// How exitWithError treats the token, set up in main
+struct ExitTokenPolicy
+{
+    // Always set with a token store, the stored token stays usable by the next run
+    bool keepToken = false;
+    std::optional<TokenStore> store;
+    // Set instead of a client when running with a credentials file
+    SessionManager* sessions = nullptr;
+};
+static ExitTokenPolicy exitTokenPolicy;
+
+// Metrics are also written when exiting with an error, slow or failing runs are the interesting ones
+static std::string exitMetricsFile;
+
+void writeSessionMetrics(SessionManager& sessions)
+{
+    if (!exitMetricsFile.empty()) {
+        MetricsRegistry metrics;
+        sessions.collectMetrics(metrics);
+        metrics.writeFile(exitMetricsFile);
+    }
+}
+
 void exitWithError(const std::string& message, int exitCode = 1, LopDnsClient* client = nullptr)
 {
     LOG_ERROR << message;
-    if (client != nullptr) {
+    if (exitTokenPolicy.sessions != nullptr) {
+        writeSessionMetrics(*exitTokenPolicy.sessions);
+        if (!exitTokenPolicy.keepToken) {
+            exitTokenPolicy.sessions->invalidateTokens();
+        }
+    }
+    if (client != nullptr && !exitMetricsFile.empty()) {
+        client->getMetrics().writeFile(exitMetricsFile);
+    }
+    if (client != nullptr && !exitTokenPolicy.keepToken) {
         client->invalidateToken();
     }
     exit(exitCode);
 }
 
+// Reuses a stored token that is not about to expire, otherwise authenticates. New tokens are stored.
+bool authenticate(LopDnsClient& client, const Settings& settings)
+{
+    exitTokenPolicy.keepToken = settings.keep_token || settings.token_store;
+    if (!settings.token_store) {
+        return client.authenticate(settings.client_id, settings.token_duration_sec);
+    }
+
+    exitTokenPolicy.store.emplace(settings.token_store_dir.empty() ? TokenStore::defaultDirectory() : settings.token_store_dir);
+    TokenStore* store = &exitTokenPolicy.store.value();
+    std::string clientId = settings.client_id;
+    client.setTokenListener([store, clientId](const Token& token) {
+        store->save(clientId, token);
+    });
+
+    Token storedToken;
+    if (store->load(settings.client_id, storedToken)) {
+        client.restoreToken(settings.client_id, settings.token_duration_sec, storedToken);
+        if (!client.isTokenExpired(settings.token_refresh_margin_sec)) {
+            LOG_DEBUG << "Reusing stored token.";
+            return true;
+        }
+        LOG_DEBUG << "Stored token expires within " << settings.token_refresh_margin_sec << " seconds, refreshing it.";
+    }
+    return client.authenticate(settings.client_id, settings.token_duration_sec);
+}
+
+// Logs the results in zone order and exits on the first failed zone
+int reportZoneResults(const std::vector<ZoneResult>& results, LopDnsClient* client)
+{
+    int processedRecords = 0;
+    for (const auto& result : results) {
+        if (results.size() > 1) {
+            LOG_INFO << "Zone " << result.zone << ":";
+        }
+        for (const auto& message : result.messages) {
+            LOG_INFO << message;
+        }
+        processedRecords += result.processedRecords;
+    }
+    for (const auto& result : results) {
+        if (result.exitCode != 0) {
+            exitWithError(result.error + " (zone: " + result.zone + ")", result.exitCode, client);
+        }
+    }
+    return processedRecords;
+}
+
+void logRecord(const Record& record)
+{
+    LOG_INFO << "  Name: " << record.name << ", Type: " << record.type
+              << ", Content: " << record.content << ", TTL: " << record.ttl
+              << ", Priority: " << record.priority << "\n";
+}
+
+// Prints the records of the zones in zone order and returns the number of zones that could not
+// be fetched. A single zone is printed while it is received. Several zones are fetched in
+// parallel, up to --concurrency at a time, and each group is printed once it is complete.
+size_t logZoneRecords(const ClientForZone& clientForZone, const std::vector<std::string>& zones, const Settings& settings)
+{
+    if (zones.size() == 1) {
+        const std::string& zone = zones.front();
+        LOG_INFO << "Records in zone " << zone << ":";
+        bool fetched = clientForZone(zone).forEachRecord(zone, [](const Record& record) {
+            logRecord(record);
+            return true;
+        });
+        if (!fetched) {
+            LOG_ERROR << "Failed to fetch the records of zone " << zone << ".";
+            return 1;
+        }
+        return 0;
+    }
+
+    size_t failed = 0;
+    size_t groupSize = static_cast<size_t>(std::max(settings.concurrency, 1));
+    for (size_t start = 0; start < zones.size(); start += groupSize) {
+        std::vector<std::string> group(zones.begin() + start, zones.begin() + std::min(start + groupSize, zones.size()));
+        auto groupRecords = parallelMap(group, settings.concurrency, [&clientForZone](const std::string& zone) {
+            std::vector<Record> records;
+            bool fetched = clientForZone(zone).getRecords(zone, records);
+            return std::make_pair(fetched, std::move(records));
+        });
+        for (size_t i = 0; i < group.size(); i++) {
+            LOG_INFO << "Records in zone " << group[i] << ":";
+            if (!groupRecords[i].first) {
+                LOG_ERROR << "Failed to fetch the records of zone " << group[i] << ".";
+                failed++;
+                continue;
+            }
+            for (const auto& record : groupRecords[i].second) {
+                logRecord(record);
+            }
+        }
+    }
+    return failed;
+}
+
+// Reads the desired-state file, limited to the zone of the settings if one is given
+DesiredState loadDesiredState(const Settings& settings, LopDnsClient* client)
+{
+    std::ifstream desiredStateFile(settings.desired_state_file);
+    if (!desiredStateFile) {
+        exitWithError("Failed to open desired-state file: " + settings.desired_state_file, 14, client);
+    }
+    DesiredState desiredState;
+    try
+    {
+        desiredState = readDesiredState(desiredStateFile);
+    }
+    catch (const std::exception& e)
+    {
+        exitWithError(e.what(), 14, client);
+    }
+    if (!settings.zone.empty()) {
+        auto zoneState = desiredState.find(settings.zone);
+        if (zoneState == desiredState.end()) {
+            exitWithError("Zone not found in desired-state file: " + settings.zone, 14, client);
+        }
+        desiredState = DesiredState{*zoneState};
+    }
+    return desiredState;
+}
+
+// The records of a snapshot as desired state, limited to the zone of the settings if one is given
+DesiredState loadSnapshotState(const Settings& settings, LopDnsClient* client)
+{
+    DesiredState desiredState;
+    try
+    {
+        ZoneSnapshot snapshot(settings.snapshot_file);
+        for (size_t zone = 0; zone < snapshot.zoneCount(); zone++) {
+            std::string zoneName(snapshot.zoneName(zone));
+            if (settings.zone.empty() || zoneName == settings.zone) {
+                desiredState[zoneName] = snapshot.records(zone);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        exitWithError(e.what(), 18, client);
+    }
+    if (!settings.zone.empty() && desiredState.empty()) {
+        exitWithError("Zone not found in snapshot: " + settings.zone, 18, client);
+    }
+    return desiredState;
+}
+
+// get-records --from-snapshot, the records are printed straight from the mapped file
+void logSnapshotRecords(const Settings& settings)
+{
+    try
+    {
+        ZoneSnapshot snapshot(settings.snapshot_file);
+        std::optional<size_t> onlyZone;
+        if (!settings.zone.empty()) {
+            onlyZone = snapshot.findZone(settings.zone);
+            if (!onlyZone.has_value()) {
+                exitWithError("Zone not found in snapshot: " + settings.zone, 2);
+            }
+        }
+        LOG_DEBUG << "Snapshot written at " << snapshot.createdAt() << ".";
+        for (size_t zone = 0; zone < snapshot.zoneCount(); zone++) {
+            if (onlyZone.has_value() && zone != onlyZone.value()) {
+                continue;
+            }
+            LOG_INFO << "Records in zone " << snapshot.zoneName(zone) << ":";
+            snapshot.forEachRecord(zone, [](const SnapshotRecordView& record) {
+                LOG_INFO << "  Name: " << record.name << ", Type: " << record.type
+                          << ", Content: " << record.content << ", TTL: " << record.ttl
+                          << ", Priority: " << record.priority << "\n";
+            });
+        }
+    }
+    catch (const std::exception& e)
+    {
+        exitWithError(e.what(), 18);
+    }
+}
+
+// Fetches the records of every zone and writes them to the snapshot file. A zone that could
+// not be fetched aborts the snapshot before the file is replaced, stored as an empty zone it
+// would delete the live records when the snapshot is restored.
+void writeSnapshot(const ClientForZone& clientForZone, const std::vector<std::string>& zones, const Settings& settings,
+                   LopDnsClient* client)
+{
+    std::vector<std::vector<Record>> zoneRecords(zones.size());
+    std::vector<size_t> indexes(zones.size());
+    for (size_t i = 0; i < zones.size(); i++) {
+        indexes[i] = i;
+    }
+    auto fetched = parallelMap(indexes, settings.concurrency, [&clientForZone, &zones, &zoneRecords](size_t i) {
+        return clientForZone(zones[i]).getRecords(zones[i], zoneRecords[i]);
+    });
+    size_t failed = 0;
+    for (size_t i = 0; i < zones.size(); i++) {
+        if (!fetched[i]) {
+            LOG_ERROR << "Failed to fetch the records of zone " << zones[i] << ".";
+            failed++;
+        }
+    }
+    if (failed > 0) {
+        exitWithError("Snapshot not written, " + std::to_string(failed) + " zones could not be fetched.", 18, client);
+    }
+    if (!writeZoneSnapshot(settings.snapshot_file, zones, zoneRecords)) {
+        exitWithError("Failed to write snapshot: " + settings.snapshot_file, 18, client);
+    }
+    LOG_INFO << "Wrote " << zones.size() << " zones to " << settings.snapshot_file << ".";
+}
+
+// Writes the records of the zone of the settings as a master file
+bool exportZoneFile(LopDnsClient& client, const Settings& settings)
+{
+    std::ofstream file;
+    if (settings.zone_file != "-") {
+        file.open(settings.zone_file, std::ios::trunc);
+        if (!file) {
+            LOG_ERROR << "Failed to open zone file: " << settings.zone_file;
+            return false;
+        }
+    }
+    std::ostream& output = settings.zone_file == "-" ? std::cout : file;
+    ZoneFileWriter writer(output, settings.zone);
+    writer.writeHeader();
+    bool fetched = client.forEachRecord(settings.zone, [&writer](const Record& record) {
+        writer.write(record);
+        return true;
+    });
+    if (!fetched) {
+        LOG_ERROR << "Failed to get the records of zone " << settings.zone;
+        return false;
+    }
+    output.flush();
+    if (!output) {
+        LOG_ERROR << "Failed to write zone file: " << settings.zone_file;
+        return false;
+    }
+    LOG_INFO << "Exported " << writer.written() << " records of zone " << settings.zone << ".";
+    return true;
+}
+
+// An imported record is created, or its TTL and priority are updated if it exists with the same content
+BatchOperation zoneFileOperation(const std::string& zone, const Record& record, size_t line)
+{
+    BatchOperation operation;
+    operation.line = line;
+    operation.action = BATCH_CREATE_OR_UPDATE_RECORD;
+    operation.actionName = "createorupdate-record";
+    operation.zone = zone;
+    operation.name = record.name;
+    operation.type = record.type;
+    operation.content = record.content;
+    operation.newContent = record.content;
+    operation.ttl = record.ttl;
+    if (record.type == "MX" || record.type == "SRV") {
+        operation.priority = record.priority;
+    }
+    operation.allRecords = false;
+    return operation;
+}
+
+// Applies the operations and prints one result line per operation in input order, returns the failed count
+int writeBatchResults(BatchProcessor& batch, const std::vector<std::string>& zones)
+{
+    int failed = 0;
+    for (const auto& result : batch.apply(zones)) {
+        BatchProcessor::writeResult(std::cout, result);
+        if (!result.success) {
+            failed++;
+        }
+    }
+    std::cout.flush();
+    return failed;
+}
+
+// Logs the plan or the applied changes of every zone, returns the number of failed changes and zones
+size_t reportReconcileResults(const std::vector<ReconcileResult>& results, const Settings& settings)
+{
+    size_t failed = 0;
+    for (const auto& result : results) {
+        const ChangeSet& changeSet = result.changeSet;
+        if (!result.error.empty()) {
+            LOG_ERROR << "Zone " << changeSet.zone << ": " << result.error;
+            failed++;
+            continue;
+        }
+        size_t creates = 0, updates = 0, deletes = 0;
+        for (const auto& change : changeSet.changes) {
+            creates += change.type == RECORD_CREATE;
+            updates += change.type == RECORD_UPDATE;
+            deletes += change.type == RECORD_DELETE;
+        }
+        LOG_INFO << (settings.dry_run ? "Plan for zone " : "Zone ") << changeSet.zone << ": " << creates
+                 << " to create, " << updates << " to update, " << deletes << " to delete, "
+                 << changeSet.unchanged << " unchanged.";
+        for (const auto& message : result.messages) {
+            LOG_INFO << "  " << message;
+        }
+        failed += result.failed;
+    }
+    return failed;
+}
+
+static volatile std::sig_atomic_t stopRequested = 0;
+
+void requestStop(int)
+{
+    stopRequested = 1;
+}
+
+// Runs the tasks of the config file every interval until SIGINT or SIGTERM, or once. The client,
+// its token and its connections are kept for the whole run.
+void runDaemon(LopDnsClient& client, const Settings& settings)
+{
+    std::ifstream configFile(settings.config_file);
+    if (!configFile) {
+        exitWithError("Failed to open config file: " + settings.config_file, 12, &client);
+    }
+    std::vector<DnsTask> tasks;
+    std::unique_ptr<DnsTaskRunner> runner;
+    try
+    {
+        tasks = readDnsTasks(configFile);
+        runner = std::make_unique<DnsTaskRunner>(client, tasks, settings.static_content, settings.concurrency);
+    }
+    catch (const std::exception& e)
+    {
+        exitWithError(e.what(), 12, &client);
+    }
+
+    MetricsEndpoint metricsEndpoint(client.getMetrics());
+    if (settings.metrics_port > 0 && !metricsEndpoint.start(settings.metrics_address, settings.metrics_port)) {
+        exitWithError("Failed to start the metrics endpoint.", 16, &client);
+    }
+
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    if (settings.once) {
+        LOG_INFO << "Running " << tasks.size() << " tasks once.";
+    } else {
+        LOG_INFO << "Running " << tasks.size() << " tasks every " << settings.interval_sec << " seconds.";
+    }
+
+    while (!stopRequested) {
+        if (client.isTokenExpired(settings.token_refresh_margin_sec)) {
+            LOG_DEBUG << "Token expires within " << settings.token_refresh_margin_sec << " seconds, refreshing it.";
+            if (!client.authenticate(settings.client_id, settings.token_duration_sec)) {
+                LOG_ERROR << "Failed to refresh the token.";
+            }
+        }
+
+        DnsTaskCycleStats stats = runner->runCycle();
+        LOG_DEBUG << "Cycle done: " << stats.zonesFetched << " zones fetched, " << stats.updated << " updated, "
+                  << stats.unchanged << " unchanged, " << stats.failed << " failed.";
+        if (!settings.metrics_file.empty()) {
+            client.getMetrics().writeFile(settings.metrics_file);
+        }
+        if (settings.once) {
+            if (stats.failed > 0) {
+                exitWithError(std::to_string(stats.failed) + " tasks failed.", 13, &client);
+            }
+            return;
+        }
+
+        // Sleep in short steps so that a stop request is handled quickly
+        auto wakeUp = std::chrono::steady_clock::now() + std::chrono::seconds(settings.interval_sec);
+        while (!stopRequested && std::chrono::steady_clock::now() < wakeUp) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+    }
+    LOG_INFO << "Shutting down.";
+}
+
+// Waits until an address of the interface changed and no further change followed for the debounce
+// time, or until the interval passed. Returns true if the addresses changed.
+bool waitForAddressChange(AddressWatcher& watcher, const Settings& settings)
+{
+    const auto step = std::chrono::milliseconds(200);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(settings.interval_sec);
+    bool changed = false;
+    while (!stopRequested && !changed && std::chrono::steady_clock::now() < deadline) {
+        changed = watcher.waitForChange(step);
+    }
+    if (!changed) {
+        return false;
+    }
+    auto debounce = std::chrono::milliseconds(settings.debounce_ms);
+    auto quietUntil = std::chrono::steady_clock::now() + debounce;
+    while (!stopRequested && std::chrono::steady_clock::now() < quietUntil) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(quietUntil - std::chrono::steady_clock::now());
+        if (watcher.waitForChange(std::min(step, remaining))) {
+            LOG_DEBUG << "Address changed again, waiting " << settings.debounce_ms << " ms.";
+            quietUntil = std::chrono::steady_clock::now() + debounce;
+        }
+    }
+    return true;
+}
+
+// Publishes the address of an interface to a record whenever it changes, until SIGINT or SIGTERM.
+// The API is only called when the address differs from the last published one. The addresses are
+// also read every interval, which costs no request, so a failed update is retried then.
+void runWatchAddress(LopDnsClient& client, const Settings& settings)
+{
+    if (settings.record_type != "A" && settings.record_type != "AAAA") {
+        exitWithError("watch-address publishes A and AAAA records only.", 20, &client);
+    }
+    AddressWatcher watcher(settings.interface_name, settings.record_type == "AAAA" ? AF_INET6 : AF_INET);
+    if (!watcher.open()) {
+        exitWithError("Failed to watch the addresses of " + settings.interface_name + ".", 20, &client);
+    }
+
+    std::string key = settings.zone + "/" + settings.record_name + "/" + settings.record_type;
+    PublishedAddresses published;
+    if (!settings.state_file.empty()) {
+        loadPublishedAddresses(settings.state_file, published);
+    }
+    if (published.find(key) == published.end()) {
+        // Without a state the record itself tells what was published, a current record is not updated
+        std::vector<Record> zoneRecords;
+        if (client.getRecords(settings.zone, zoneRecords)) {
+            ZoneIndex index(zoneRecords);
+            auto records = index.find(settings.record_name, settings.record_type);
+            if (!records.empty()) {
+                published[key] = records.front().content;
+            }
+        } else {
+            LOG_WARNING << "Failed to fetch the records of zone " << settings.zone
+                        << ", the published address is unknown.";
+        }
+    }
+
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    LOG_INFO << "Publishing the " << settings.record_type << " address of " << settings.interface_name
+             << " to " << settings.record_name << ".";
+
+    Settings updateSettings = settings;
+    updateSettings.action = ACTION_CREATE_OR_UPDATE_RECORD;
+    Selection selection(settings);
+    while (!stopRequested) {
+        auto addresses = watcher.addresses();
+        if (addresses.empty()) {
+            LOG_WARNING << "No usable " << settings.record_type << " address on " << settings.interface_name << ".";
+        } else if (addresses.front() == published[key]) {
+            LOG_DEBUG << "Address " << addresses.front() << " is published already.";
+        } else {
+            if (client.isTokenExpired(settings.token_refresh_margin_sec)
+                && !client.authenticate(settings.client_id, settings.token_duration_sec)) {
+                LOG_ERROR << "Failed to refresh the token.";
+            }
+            updateSettings.new_record_content = addresses.front();
+            ZoneResult result = updateRecordsInZone(client, updateSettings, selection);
+            for (const auto& message : result.messages) {
+                LOG_INFO << message;
+            }
+            if (result.exitCode != 0) {
+                LOG_ERROR << result.error << " Retrying in " << settings.interval_sec << " seconds.";
+            } else if (!settings.dry_run) {
+                published[key] = addresses.front();
+                if (!settings.state_file.empty()) {
+                    savePublishedAddresses(settings.state_file, published);
+                }
+            }
+            if (!settings.metrics_file.empty()) {
+                client.getMetrics().writeFile(settings.metrics_file);
+            }
+        }
+        waitForAddressChange(watcher, settings);
+    }
+    LOG_INFO << "Shutting down.";
+}
+
+void writeMetrics(LopDnsClient& client)
+{
+    if (!exitMetricsFile.empty()) {
+        client.getMetrics().writeFile(exitMetricsFile);
+    }
+}
+
+void logConnectionStats(LopDnsClient& client)
+{
+    ConnectionPoolStats stats = client.getConnectionPoolStats();
+    LOG_DEBUG << "Connections: created " << stats.created << ", reused " << stats.reused
+              << ", evicted " << stats.evicted << ", open " << stats.open;
+    LOG_DEBUG << "Reads shared with a running request: " << client.getCoalescedReads();
+}
+
+ConnectionPoolSettings poolSettingsFrom(const Settings& settings)
+{
+    ConnectionPoolSettings poolSettings;
+    poolSettings.maxConnections = settings.max_connections;
+    poolSettings.idleTimeoutInSeconds = settings.connection_idle_timeout_sec;
+    poolSettings.compressResponses = settings.compression;
+    poolSettings.compressRequestsFromBytes = static_cast<size_t>(settings.compress_requests_from_bytes);
+    return poolSettings;
+}
+
+RetrySettings retrySettingsFrom(const Settings& settings)
+{
+    RetrySettings retrySettings;
+    retrySettings.maxAttempts = settings.max_attempts;
+    retrySettings.baseDelayInMilliseconds = settings.retry_base_delay_ms;
+    retrySettings.maxDelayInMilliseconds = settings.retry_max_delay_ms;
+    return retrySettings;
+}
+
+void runAccountAction(SessionManager& sessions, const Settings& settings);
+
+// Every account reconciles the zones it owns, zones of no account are reported as errors
+std::vector<ReconcileResult> reconcileAccounts(SessionManager& sessions, const DesiredState& desiredState, const Settings& settings)
+{
+    std::map<std::string, DesiredState> desiredStateByAccount;
+    std::vector<ReconcileResult> results;
+    for (const auto& zoneState : desiredState) {
+        std::string account = sessions.accountForZone(zoneState.first);
+        if (account.empty()) {
+            ReconcileResult result;
+            result.changeSet.zone = zoneState.first;
+            result.error = "zone not found in any account";
+            results.push_back(result);
+            continue;
+        }
+        desiredStateByAccount[account].insert(zoneState);
+    }
+    auto accountZones = sessions.zonesByAccount();
+    auto accountResults = sessions.forEachAccount([&](const std::string& account, LopDnsClient& client) {
+        auto accountState = desiredStateByAccount.find(account);
+        if (accountState == desiredStateByAccount.end()) {
+            return std::vector<ReconcileResult>();
+        }
+        Reconciler reconciler(client, settings.concurrency, settings.dry_run);
+        return reconciler.reconcile(accountState->second, accountZones.at(account));
+    });
+    for (auto& accountResult : accountResults) {
+        results.insert(results.end(), accountResult.begin(), accountResult.end());
+    }
+    std::sort(results.begin(), results.end(), [](const ReconcileResult& a, const ReconcileResult& b) {
+        return a.changeSet.zone < b.changeSet.zone;
+    });
+    return results;
+}
+
+// Runs the action for the accounts of the credentials file. Every account is authenticated
+// once, every zone is processed with the client of the account that owns it.
+void runAccounts(const Settings& settings)
+{
+    std::ifstream credentialsFile(settings.credentials_file);
+    if (!credentialsFile) {
+        exitWithError("Failed to open credentials file: " + settings.credentials_file, 17);
+    }
+    std::vector<AccountCredentials> accounts;
+    try
+    {
+        accounts = readCredentials(credentialsFile);
+    }
+    catch (const std::exception& e)
+    {
+        exitWithError(e.what(), 17);
+    }
+
+    SessionSettings sessionSettings;
+    sessionSettings.baseUrl = settings.base_url;
+    sessionSettings.timeoutInSeconds = settings.timeout;
+    sessionSettings.poolSettings = poolSettingsFrom(settings);
+    sessionSettings.retrySettings = retrySettingsFrom(settings);
+    sessionSettings.tokenDurationInSeconds = settings.token_duration_sec;
+    sessionSettings.tokenRefreshMarginInSeconds = settings.token_refresh_margin_sec;
+    sessionSettings.recordCacheInSeconds = settings.record_cache_sec;
+    sessionSettings.concurrency = settings.concurrency;
+    if (settings.token_store) {
+        sessionSettings.tokenStoreDirectory = settings.token_store_dir.empty() ? TokenStore::defaultDirectory() : settings.token_store_dir;
+    }
+    SessionManager sessions(accounts, sessionSettings);
+    exitTokenPolicy.keepToken = settings.keep_token || settings.token_store;
+    exitTokenPolicy.sessions = &sessions;
+    // Handled here so that exitWithError can still reach the sessions
+    try
+    {
+        runAccountAction(sessions, settings);
+    }
+    catch (const std::exception& e)
+    {
+        exitWithError("Unhandled exception occurred: " + std::string(e.what()), 99);
+    }
+
+    writeSessionMetrics(sessions);
+    ConnectionPoolStats stats = sessions.getConnectionPoolStats();
+    LOG_DEBUG << "Connections of " << sessions.size() << " accounts: created " << stats.created << ", reused "
+              << stats.reused << ", evicted " << stats.evicted << ", open " << stats.open;
+    exitTokenPolicy.sessions = nullptr;
+}
+
+void runAccountAction(SessionManager& sessions, const Settings& settings)
+{
+    std::vector<std::string> failedAccounts = sessions.refreshTokens(settings.token_refresh_margin_sec);
+    if (!failedAccounts.empty()) {
+        exitWithError("Authentication failed for " + std::to_string(failedAccounts.size()) + " of "
+                      + std::to_string(sessions.size()) + " accounts.");
+    }
+
+    std::vector<std::string> zones = sessions.discoverZones();
+    if (!settings.zone.empty()) {
+        if (sessions.clientForZone(settings.zone) == nullptr) {
+            exitWithError("Specified zone not found in any account: " + settings.zone, 2);
+        }
+        zones = {settings.zone};
+    }
+    else if (zones.empty()) {
+        exitWithError("No zones available to retrieve records from.", 3);
+    }
+    ClientForZone owningClient = [&sessions](const std::string& zone) -> LopDnsClient& {
+        return *sessions.clientForZone(zone);
+    };
+
+    switch (settings.action) {
+        case ACTION_GET_ZONES:
+        {
+            for (const auto& account : sessions.zonesByAccount()) {
+                LOG_INFO << "Zones of account " << account.first << ":";
+                for (const auto& zone : account.second) {
+                    if (settings.zone.empty() || zone == settings.zone) {
+                        LOG_INFO << "  " << zone;
+                    }
+                }
+            }
+            break;
+        }
+        case ACTION_GET_RECORDS:
+        {
+            size_t failed = logZoneRecords(owningClient, zones, settings);
+            if (failed > 0) {
+                exitWithError("Failed to fetch the records of " + std::to_string(failed) + " zones.", 21);
+            }
+            break;
+        }
+        case ACTION_CREATE_RECORD:
+        {
+            Record newRecord;
+            std::list<std::string> messages;
+            bool created = createRecord(owningClient(settings.zone), settings, newRecord, messages);
+            for (const auto& message : messages) {
+                LOG_INFO << message;
+            }
+            if (!created) {
+                exitWithError("Failed to create record.", 4);
+            }
+            break;
+        }
+        case ACTION_UPDATE_RECORD:
+        case ACTION_CREATE_OR_UPDATE_RECORD:
+        {
+            int updated = reportZoneResults(runOnZones(owningClient, settings, zones, updateRecordsInZone), nullptr);
+            if (updated == 0 && settings.action == ACTION_UPDATE_RECORD) {
+                exitWithError("No records updated for name: " + settings.record_name + " and type: " + settings.record_type, 6);
+            }
+            break;
+        }
+        case ACTION_DELETE_RECORD:
+        {
+            int deleted = reportZoneResults(runOnZones(owningClient, settings, zones, deleteRecordsInZone), nullptr);
+            if (deleted == 0) {
+                exitWithError("No matching records found to delete.", 7);
+            }
+            break;
+        }
+        case ACTION_EXPORT_ZONEFILE:
+        {
+            if (!exportZoneFile(owningClient(settings.zone), settings)) {
+                exitWithError("Failed to export zone " + settings.zone + ".", 19);
+            }
+            break;
+        }
+        case ACTION_SNAPSHOT:
+        {
+            writeSnapshot(owningClient, zones, settings, nullptr);
+            break;
+        }
+        case ACTION_RECONCILE:
+        case ACTION_RESTORE_FROM_SNAPSHOT:
+        {
+            DesiredState desiredState = settings.action == ACTION_RECONCILE
+                ? loadDesiredState(settings, nullptr) : loadSnapshotState(settings, nullptr);
+            size_t failed = reportReconcileResults(reconcileAccounts(sessions, desiredState, settings), settings);
+            if (failed > 0) {
+                exitWithError(std::to_string(failed) + " changes or zones failed to reconcile.", 15);
+            }
+            break;
+        }
+        default:
+            exitWithError("The action cannot be used with a credentials file.", 9);
+    }
+}
+
 int main(int argc, char* argv[])
 {
   static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
@@ -513,14 +1655,44 @@ int main(int argc, char* argv[])
     }
 
     logSettings(settings);
+    exitMetricsFile = settings.metrics_file;
 
-    LopDnsClient client(settings.base_url, settings.timeout);
+    if (settings.from_snapshot) {
+        logSnapshotRecords(settings);
+        return 0;
+    }
+    if (!settings.credentials_file.empty()) {
+        runAccounts(settings);
+        return 0;
+    }
+
+    LopDnsClient client(settings.base_url, settings.timeout, poolSettingsFrom(settings));
+    client.setRetrySettings(retrySettingsFrom(settings));
+    client.setTokenRefreshMargin(settings.token_refresh_margin_sec);
+    if (settings.record_cache_sec > 0) {
+        client.enableRecordCache(settings.record_cache_sec);
+    }
 
-    if (!client.authenticate(settings.client_id, settings.token_duration_sec)) {
+    if (!authenticate(client, settings)) {
         exitWithError("Authentication failed.");
     }
 
-    std::list<std::string> zones = client.getZones();
+    // The daemon fetches the zones itself in every cycle
+    if (settings.action == ACTION_DAEMON) {
+        runDaemon(client, settings);
+        writeMetrics(client);
+        logConnectionStats(client);
+        return 0;
+    }
+    if (settings.action == ACTION_WATCH_ADDRESS) {
+        runWatchAddress(client, settings);
+        writeMetrics(client);
+        logConnectionStats(client);
+        return 0;
+    }
+
+    ClientForZone singleClient = [&client](const std::string&) -> LopDnsClient& { return client; };
+    std::vector<std::string> zones = client.getZones();
     if (!settings.zone.empty()) {
         if (std::find(zones.begin(), zones.end(), settings.zone) == zones.end()) {
             exitWithError("Specified zone not found: " + settings.zone, 2, &client);
@@ -544,22 +1716,21 @@ int main(int argc, char* argv[])
         }
         case ACTION_GET_RECORDS:
         {
-            // Retrieve and print records for each zone
-            for (const auto& zone : zones) {
-                LOG_INFO << "Records in zone " << zone << ":";
-                auto records = client.getRecords(zone);
-                for (const auto& record : records) {
-                    LOG_INFO << "  Name: " << record.name << ", Type: " << record.type
-                              << ", Content: " << record.content << ", TTL: " << record.ttl
-                              << ", Priority: " << record.priority << "\n";
-                }
+            size_t failed = logZoneRecords(singleClient, zones, settings);
+            if (failed > 0) {
+                exitWithError("Failed to fetch the records of " + std::to_string(failed) + " zones.", 21, &client);
             }
             break;
         }
         case ACTION_CREATE_RECORD:
         {
             Record newRecord;
-            if (!createRecord(client, settings, newRecord)) {
+            std::list<std::string> messages;
+            bool created = createRecord(client, settings, newRecord, messages);
+            for (const auto& message : messages) {
+                LOG_INFO << message;
+            }
+            if (!created) {
                 exitWithError("Failed to create record.", 4, &client);
             }
             break;
@@ -567,71 +1738,107 @@ int main(int argc, char* argv[])
         case ACTION_UPDATE_RECORD:
         case ACTION_CREATE_OR_UPDATE_RECORD:
         {         
-            auto records = getRecords(client, settings);
-            bool updated = false;
-            for (const auto& record : records) {
-                std::optional<std::string> new_content;
-                if (settings.replace_record_content_regex.empty()) {
-                    if (settings.new_record_content.has_value()) {
-                        new_content = settings.new_record_content;
-                    }
-                }
-                else if (settings.new_record_content.has_value()) {
-                    new_content = std::regex_replace(record.content, std::regex(settings.replace_record_content_regex), settings.new_record_content.value());
-                }
-                
-                Record updatedRecord;
-                if (updateRecord(client, settings, record, new_content, updatedRecord))
-                {
-                    updated = true;
-                } else {
-                    exitWithError("Failed to update record.", 5, &client);
-                }   
-
-                if (!settings.all_records) {
-                    break;
-                }
-            }
-            if (!updated) {
-                if (settings.action == ACTION_UPDATE_RECORD) {
-                    LOG_INFO << "No records updated for name: " << settings.record_name
-                          << " and type: " << settings.record_type << "\n";
-                    exitWithError("No records updated for name: " + settings.record_name + " and type: " + settings.record_type, 6, &client);
-                }
-                else if (settings.action == ACTION_CREATE_OR_UPDATE_RECORD) {
-                    LOG_INFO << "No matching records found. Creating new record." << std::endl;
-                    Record newRecord;
-                    if (!createRecord(client, settings, newRecord)) {
-                        exitWithError("Failed to create record.", 4, &client);
-                    }
-                }
+            auto results = runOnZones(singleClient, settings, zones, updateRecordsInZone);
+            int updated = reportZoneResults(results, &client);
+            if (updated == 0 && settings.action == ACTION_UPDATE_RECORD) {
+                LOG_INFO << "No records updated for name: " << settings.record_name
+                      << " and type: " << settings.record_type << "\n";
+                exitWithError("No records updated for name: " + settings.record_name + " and type: " + settings.record_type, 6, &client);
             }
             break;
         }
         case ACTION_DELETE_RECORD:
         {
-            auto records = getRecords(client, settings);
-            if (records.empty()) {
+            auto results = runOnZones(singleClient, settings, zones, deleteRecordsInZone);
+            int deleted = reportZoneResults(results, &client);
+            if (deleted == 0) {
                 LOG_INFO << "No matching records found to delete." << std::endl;
                 exitWithError("No matching records found to delete.", 7, &client);
             }
-            for (const auto& record : records) {
-                if (!deleteRecord(client, settings, record)) {
-                    exitWithError("Failed to delete record.", 8, &client);
+            break;
+        }
+        case ACTION_APPLY_BATCH:
+        {
+            BatchProcessor batch(client, settings.concurrency, settings.dry_run);
+            if (settings.batch_file == "-") {
+                batch.readOperations(std::cin);
+            }
+            else {
+                std::ifstream batchFile(settings.batch_file);
+                if (!batchFile) {
+                    exitWithError("Failed to open batch file: " + settings.batch_file, 10, &client);
                 }
-                if (!settings.all_records) {
-                    if (records.size() > 1) {
-                        LOG_INFO << "Multiple matching records found, but 'all_records' flag is not set. Stopping after first deletion." << std::endl;
-                    }
-                    break;
+                batch.readOperations(batchFile);
+            }
+
+            // One result line per operation, in the order of the batch file
+            int failed = writeBatchResults(batch, zones);
+            if (failed > 0) {
+                exitWithError(std::to_string(failed) + " batch operations failed.", 11, &client);
+            }
+            break;
+        }
+        case ACTION_EXPORT_ZONEFILE:
+        {
+            if (!exportZoneFile(client, settings)) {
+                exitWithError("Failed to export zone " + settings.zone + ".", 19, &client);
+            }
+            break;
+        }
+        case ACTION_IMPORT_ZONEFILE:
+        {
+            // The records are read one by one and run through the batch pipeline, one result line per record
+            std::ifstream zoneFile;
+            if (settings.zone_file != "-") {
+                zoneFile.open(settings.zone_file);
+                if (!zoneFile) {
+                    exitWithError("Failed to open zone file: " + settings.zone_file, 19, &client);
+                }
+            }
+            BatchProcessor batch(client, settings.concurrency, settings.dry_run);
+            try
+            {
+                ZoneFileReader reader(settings.zone_file == "-" ? std::cin : zoneFile, settings.zone);
+                Record record;
+                while (reader.next(record)) {
+                    batch.addOperation(zoneFileOperation(settings.zone, record, reader.line()));
                 }
             }
+            catch (const std::runtime_error& e)
+            {
+                exitWithError(e.what(), 19, &client);
+            }
+            int failed = writeBatchResults(batch, zones);
+            if (failed > 0) {
+                exitWithError(std::to_string(failed) + " records failed to import.", 11, &client);
+            }
+            break;
+        }
+        case ACTION_SNAPSHOT:
+        {
+            writeSnapshot([&client](const std::string&) -> LopDnsClient& { return client; }, zones, settings, &client);
+            break;
+        }
+        case ACTION_RECONCILE:
+        case ACTION_RESTORE_FROM_SNAPSHOT:
+        {
+            // Restoring applies the difference between the live records and the snapshot
+            DesiredState desiredState = settings.action == ACTION_RECONCILE
+                ? loadDesiredState(settings, &client) : loadSnapshotState(settings, &client);
+            Reconciler reconciler(client, settings.concurrency, settings.dry_run);
+            size_t failed = reportReconcileResults(reconciler.reconcile(desiredState, zones), settings);
+            if (failed > 0) {
+                exitWithError(std::to_string(failed) + " changes or zones failed to reconcile.", 15, &client);
+            }
             break;
         }
         default:
             LOG_ERROR << "Unknown action.";
             exitWithError("Unknown action.", 9, &client);
     }
+
+    writeMetrics(client);
+    logConnectionStats(client);
   }
   catch (std::exception& e)
   {
@@ -0,0 +1,254 @@
+//
+// lopdns-bench.cpp
+// ~~~~~~~~~~~~~~~
+//
+// Drives LopDnsClient against a local MockLopDnsServer, or in-process
+// against a FakeTransport, and reports the throughput and latency
+// percentiles of every API operation.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include "args.hxx"
+#include "logging.h"
+#include "plog/Init.h"
+#include "plog/Formatters/TxtFormatter.h"
+#include "plog/Appenders/ColorConsoleAppender.h"
+#include "lopdnsclient.h"
+#include "mockserver.h"
+#include "faketransport.h"
+#include "workerpool.h"
+
+struct BenchSettings
+{
+    int iterations = 200;
+    int concurrency = 4;
+    // Retries hide the injected errors, so they are off unless asked for
+    int maxAttempts = 1;
+    // Skips HTTP and sockets, the client talks to the simulation directly
+    bool fakeTransport = false;
+    SimulationSettings server;
+};
+
+struct OperationStats
+{
+    std::string name;
+    std::vector<double> latenciesInMilliseconds;
+    int failures = 0;
+    double wallTimeInSeconds = 0.0;
+};
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    // Nearest-rank percentile
+    size_t rank = size_t(p / 100.0 * sorted.size() + 0.999999);
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+OperationStats runOperation(const std::string& name, int count, int concurrency, const std::function<bool(int)>& operation)
+{
+    std::vector<int> indexes(count);
+    for (int i = 0; i < count; i++) {
+        indexes[i] = i;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto samples = parallelMap(indexes, concurrency, [&operation](int index) {
+        auto callStart = std::chrono::steady_clock::now();
+        bool success = operation(index);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - callStart;
+        return std::make_pair(elapsed.count(), success);
+    });
+    std::chrono::duration<double> wallTime = std::chrono::steady_clock::now() - start;
+
+    OperationStats stats;
+    stats.name = name;
+    stats.wallTimeInSeconds = wallTime.count();
+    for (const auto& sample : samples) {
+        stats.latenciesInMilliseconds.push_back(sample.first);
+        if (!sample.second) {
+            stats.failures++;
+        }
+    }
+    std::sort(stats.latenciesInMilliseconds.begin(), stats.latenciesInMilliseconds.end());
+    return stats;
+}
+
+void printReport(const std::vector<OperationStats>& results)
+{
+    std::cout << std::left << std::setw(16) << "operation"
+              << std::right << std::setw(10) << "requests" << std::setw(8) << "failed"
+              << std::setw(12) << "req/s" << std::setw(10) << "p50 ms" << std::setw(10) << "p95 ms"
+              << std::setw(10) << "p99 ms" << "\n";
+    std::cout << std::fixed << std::setprecision(2);
+    for (const auto& stats : results) {
+        size_t requests = stats.latenciesInMilliseconds.size();
+        double throughput = stats.wallTimeInSeconds > 0.0 ? requests / stats.wallTimeInSeconds : 0.0;
+        std::cout << std::left << std::setw(16) << stats.name
+                  << std::right << std::setw(10) << requests << std::setw(8) << stats.failures
+                  << std::setw(12) << throughput
+                  << std::setw(10) << percentile(stats.latenciesInMilliseconds, 50)
+                  << std::setw(10) << percentile(stats.latenciesInMilliseconds, 95)
+                  << std::setw(10) << percentile(stats.latenciesInMilliseconds, 99) << "\n";
+    }
+}
+
+bool handleArgs(int argc, char* argv[], BenchSettings& settings)
+{
+    args::ArgumentParser parser("Benchmarks LopDnsClient against a local mock of the LOP DNS API");
+    args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<int> iterations(parser, "iterations", "The number of requests per operation", {'i', "iterations"}, 200);
+    args::ValueFlag<int> concurrency(parser, "concurrency", "The number of requests in flight at the same time", {"concurrency"}, 4);
+    args::ValueFlag<int> zones(parser, "zones", "The number of zones on the mock server", {"zones"}, 3);
+    args::ValueFlag<int> records(parser, "records", "The number of records per zone on the mock server", {"records"}, 100);
+    args::ValueFlag<int> latency_ms(parser, "latency_ms", "Latency added by the mock server to every request", {"latency-ms"}, 0);
+    args::ValueFlag<double> error_rate(parser, "error_rate", "Fraction of requests the mock server fails with 503", {"error-rate"}, 0.0);
+    args::ValueFlag<int> max_attempts(parser, "max_attempts", "Attempts per request of the client, see --max-attempts of lopdns-api-client", {"max-attempts"}, 1);
+    args::Flag delete_works(parser, "delete_works", "Let the mock server delete records instead of answering 500", {"delete-works"}, false);
+    args::ValueFlag<std::string> transport(parser, "transport", "How the client reaches the mock: http (local server) or fake (in-process)", {"transport"}, "http");
+
+    try
+    {
+        parser.ParseCLI(argc, argv);
+    }
+    catch (args::Help const&)
+    {
+        std::cout << parser;
+        exit(0);
+    }
+    catch (args::ParseError const& e)
+    {
+        std::cerr << e.what() << "\n" << parser;
+        return false;
+    }
+
+    if (iterations) {
+        settings.iterations = args::get(iterations);
+    }
+    if (concurrency) {
+        settings.concurrency = args::get(concurrency);
+    }
+    if (zones) {
+        settings.server.zoneCount = args::get(zones);
+    }
+    if (records) {
+        settings.server.recordsPerZone = args::get(records);
+    }
+    if (latency_ms) {
+        settings.server.latencyInMilliseconds = args::get(latency_ms);
+    }
+    if (error_rate) {
+        settings.server.errorRate = args::get(error_rate);
+    }
+    if (max_attempts) {
+        settings.maxAttempts = args::get(max_attempts);
+    }
+    if (delete_works) {
+        settings.server.deleteReturns500 = !args::get(delete_works);
+    }
+    if (transport) {
+        std::string name = args::get(transport);
+        if (name != "http" && name != "fake") {
+            std::cerr << "Unknown transport: " << name << "\n";
+            return false;
+        }
+        settings.fakeTransport = name == "fake";
+    }
+    if (settings.iterations < 1 || settings.concurrency < 1 || settings.server.zoneCount < 1) {
+        std::cerr << "Iterations, concurrency and zones must be at least 1.\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
+    plog::init(plog::fatal, &consoleAppender);
+
+    BenchSettings settings;
+    if (!handleArgs(argc, argv, settings)) {
+        return 1;
+    }
+
+    std::unique_ptr<MockLopDnsServer> server;
+    std::unique_ptr<LopDnsClient> benchClient;
+    LopDnsApiSimulation* simulation = nullptr;
+    std::string target;
+    if (settings.fakeTransport) {
+        auto transport = std::make_unique<FakeTransport>(settings.server);
+        simulation = &transport->getSimulation();
+        target = transport->describe();
+        benchClient = std::make_unique<LopDnsClient>(std::move(transport));
+    } else {
+        server = std::make_unique<MockLopDnsServer>(settings.server);
+        if (server->start() < 0) {
+            std::cerr << "Failed to start the mock server.\n";
+            return 1;
+        }
+        simulation = &server->getSimulation();
+        target = server->url();
+        ConnectionPoolSettings poolSettings;
+        poolSettings.maxConnections = settings.concurrency;
+        benchClient = std::make_unique<LopDnsClient>(server->url(), 10, poolSettings);
+    }
+    std::vector<std::string> zones = simulation->zoneNames();
+    LopDnsClient& client = *benchClient;
+    RetrySettings retrySettings;
+    retrySettings.maxAttempts = settings.maxAttempts;
+    client.setRetrySettings(retrySettings);
+
+    std::cout << "Mock server: " << target << ", " << zones.size() << " zones with "
+              << settings.server.recordsPerZone << " records, " << settings.server.latencyInMilliseconds
+              << " ms latency, error rate " << settings.server.errorRate << "\n";
+    std::cout << "Client: " << settings.iterations << " requests per operation, concurrency "
+              << settings.concurrency << "\n\n";
+
+    std::vector<OperationStats> results;
+    // The token is shared by all requests, so authentication is measured one call at a time
+    results.push_back(runOperation("authenticate", settings.iterations, 1, [&client](int) {
+        return client.authenticate("bench-client", 3600);
+    }));
+    results.push_back(runOperation("getZones", settings.iterations, settings.concurrency, [&client](int) {
+        return !client.getZones().empty();
+    }));
+    results.push_back(runOperation("getRecords", settings.iterations, settings.concurrency, [&client, &zones](int i) {
+        return !client.getRecords(zones[i % zones.size()]).empty();
+    }));
+    const std::string& zone = zones.front();
+    results.push_back(runOperation("createRecord", settings.iterations, settings.concurrency, [&client, &zone](int i) {
+        Record record = client.createRecord(zone, "bench" + std::to_string(i) + "." + zone, "TXT", "created-" + std::to_string(i));
+        return !record.name.empty();
+    }));
+    results.push_back(runOperation("updateRecord", settings.iterations, settings.concurrency, [&client, &zone](int i) {
+        std::string name = "bench" + std::to_string(i) + "." + zone;
+        Record record = client.updateRecord(zone, name, "TXT", "created-" + std::to_string(i),
+                                            std::nullopt, std::nullopt, "updated-" + std::to_string(i), std::nullopt, std::nullopt);
+        return !record.name.empty();
+    }));
+    results.push_back(runOperation("deleteRecord", settings.iterations, settings.concurrency, [&client, &zone](int i) {
+        std::string name = "bench" + std::to_string(i) + "." + zone;
+        return client.deleteRecord(zone, name, "TXT", "updated-" + std::to_string(i));
+    }));
+
+    printReport(results);
+
+    ConnectionPoolStats poolStats = client.getConnectionPoolStats();
+    std::cout << "\nServer requests: " << simulation->requestCount() << ", connections created: " << poolStats.created
+              << ", reused: " << poolStats.reused << ", coalesced reads: " << client.getCoalescedReads() << "\n";
+
+    client.invalidateToken();
+    if (server) {
+        server->stop();
+    }
+    return 0;
+}
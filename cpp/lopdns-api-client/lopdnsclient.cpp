@@ -1,8 +1,13 @@
 #include "nlohmann/json.hpp"
-#include "plog/Log.h"
+#include "logging.h"
 
 #include "lopdnsclient.h"
+#include "recordparser.h"
+#include "httptransport.h"
 #include <iostream>
+#include <cctype>
+#include <algorithm>
+#include <thread>
 
 using json = nlohmann::json;
 
@@ -10,15 +15,153 @@ const std::string USER_AGENT = "lopdns-api-client/1.0";
 const std::string ENCODING = "application/json";
 const std::string API_VERSION = "v2";
 
-LopDnsClient::LopDnsClient(const std::string& url, int timeoutInSeconds)
+// Request and response bodies are cut after this many bytes in the log
+constexpr size_t maxLoggedBodyLength = 1024;
+
+// Headers and query parameters carrying credentials, their values are never logged
+static bool isSecretParameter(const std::string& name)
+{
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    return lower == "x-token" || lower == "x-clientid" || lower == "token" || lower == "client_id";
+}
+
+// Header names are case insensitive, the map keeps them as sent by the server
+static std::string getHeader(const Headers& headers, const std::string& name)
+{
+    for (const auto& header : headers) {
+        if (header.first.size() == name.size() &&
+            std::equal(name.begin(), name.end(), header.first.begin(), [](char a, char b) {
+                return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+            })) {
+            return header.second;
+        }
+    }
+    return "";
+}
+
+// "/records/example.com" -> "/records/{zone}", keeps the number of metric series independent of the zones
+static std::string endpointTemplate(const std::string& endpoint)
+{
+    const std::string recordsPrefix = "/records/";
+    if (endpoint.compare(0, recordsPrefix.size(), recordsPrefix) == 0) {
+        return recordsPrefix + "{zone}";
+    }
+    return endpoint;
+}
+
+LopDnsClient::LopDnsClient(const std::string& url, int timeoutInSeconds, const ConnectionPoolSettings& poolSettings)
 {
     this->url = url;
-    this->timeout = timeoutInSeconds;
+    publishToken(Token{"", "", 0, ""}, "", 0);
+    this->retryPolicy = std::make_unique<RetryPolicy>();
+
+    // Connections are made to [scheme://]host[:port], a path in the URL is ignored since
+    // every endpoint is prefixed with the API version
+    auto schemeEnd = url.find("://");
+    auto pathStart = url.find('/', schemeEnd == std::string::npos ? 0 : schemeEnd + 3);
+    this->transport = std::make_unique<HttpTransport>(url.substr(0, pathStart), timeoutInSeconds, poolSettings);
+}
+
+LopDnsClient::LopDnsClient(std::unique_ptr<Transport> transport)
+{
+    this->url = transport->describe();
+    this->transport = std::move(transport);
+    publishToken(Token{"", "", 0, ""}, "", 0);
+    this->retryPolicy = std::make_unique<RetryPolicy>();
 }
 
 LopDnsClient::~LopDnsClient()
 {
-    // Cleanup if necessary
+    // Pooled connections are closed when the transport is destroyed
+}
+
+void LopDnsClient::setAsyncThreadCount(int threadCount)
+{
+    std::lock_guard<std::mutex> lock(asyncPoolMutex);
+    asyncThreadCount = std::max(threadCount, 1);
+    asyncPool.reset();
+}
+
+WorkerPool& LopDnsClient::getAsyncPool()
+{
+    std::lock_guard<std::mutex> lock(asyncPoolMutex);
+    if (!asyncPool) {
+        asyncPool = std::make_unique<WorkerPool>(asyncThreadCount);
+    }
+    return *asyncPool;
+}
+
+std::future<std::vector<std::string>> LopDnsClient::getZonesAsync(const CancellationToken& cancellation)
+{
+    return runAsync(cancellation, [this]() {
+        return getZones();
+    });
+}
+
+std::future<std::vector<Record>> LopDnsClient::getRecordsAsync(const std::string& zone_name, const CancellationToken& cancellation)
+{
+    return runAsync(cancellation, [this, zone_name]() {
+        return getRecords(zone_name);
+    });
+}
+
+std::future<Record> LopDnsClient::createRecordAsync(const std::string& zone_name, const std::string& record_name,
+                                                    const std::string& type, const std::string& content, int ttl,
+                                                    int priority, const CancellationToken& cancellation)
+{
+    return runAsync(cancellation, [this, zone_name, record_name, type, content, ttl, priority]() {
+        return createRecord(zone_name, record_name, type, content, ttl, priority);
+    });
+}
+
+std::future<Record> LopDnsClient::updateRecordAsync(const std::string& zone_name, const std::string& old_record_name,
+                                                    const std::string& matching_type, const std::string& old_content,
+                                                    const std::optional<std::string>& new_record_name,
+                                                    const std::optional<std::string>& new_type,
+                                                    const std::optional<std::string>& new_content,
+                                                    const std::optional<int>& new_ttl,
+                                                    const std::optional<int>& new_priority,
+                                                    const CancellationToken& cancellation)
+{
+    return runAsync(cancellation, [=]() {
+        return updateRecord(zone_name, old_record_name, matching_type, old_content,
+                            new_record_name, new_type, new_content, new_ttl, new_priority);
+    });
+}
+
+std::future<bool> LopDnsClient::deleteRecordAsync(const std::string& zone_name, const std::string& record_name,
+                                                  const std::string& type, const std::string& content,
+                                                  const CancellationToken& cancellation)
+{
+    return runAsync(cancellation, [this, zone_name, record_name, type, content]() {
+        return deleteRecord(zone_name, record_name, type, content);
+    });
+}
+
+void LopDnsClient::setRetrySettings(const RetrySettings& settings)
+{
+    retryPolicy = std::make_unique<RetryPolicy>(settings);
+}
+
+ConnectionPoolStats LopDnsClient::getConnectionPoolStats()
+{
+    return transport->getConnectionPoolStats();
+}
+
+void LopDnsClient::enableRecordCache(int freshnessInSeconds)
+{
+    recordCache = std::make_unique<RecordCache>(freshnessInSeconds);
+}
+
+void LopDnsClient::disableRecordCache()
+{
+    recordCache.reset();
+}
+
+RecordCacheStats LopDnsClient::getRecordCacheStats()
+{
+    return recordCache ? recordCache->getStats() : RecordCacheStats();
 }
 
 bool LopDnsClient::authenticate(const std::string& client_id, const int durationInSeconds)
@@ -33,31 +176,109 @@ bool LopDnsClient::authenticate(const std::string& client_id, const int duration
     Response response = makeRestCall("GET", "/auth/token", false, headers, queryParams);
     if (response.code >= 200 && response.code < 300)
     {
-        LOG_DEBUG << "Authentication successful. Response: " << response.body;
+        LOG_DEBUG << "Authentication successful.";
         // Parse response and set token details
         json responseBody = json::parse(response.body);
-        this->token.token = responseBody["token"];
-        this->token.expires = responseBody["expires"];
-        this->token.epochExpires = responseBody["epochExpires"].template get<long long>();
-        this->token.tzone = responseBody["tz"];
-
+        Token newToken;
+        newToken.token = responseBody["token"];
+        newToken.expires = responseBody["expires"];
+        newToken.epochExpires = responseBody["epochExpires"].template get<long long>();
+        newToken.tzone = responseBody["tz"];
+        publishToken(newToken, client_id, durationInSeconds);
+
+        if (tokenListener) {
+            tokenListener(newToken);
+        }
         return true;
     }
     else {
-        LOG_ERROR << "Authentication call failed with code: " << response.code << " body: " << response.body;
+        LOG_ERROR << "Authentication call failed with code: " << response.code << " body: "
+                  << truncateForLog(response.body, maxLoggedBodyLength);
     }
     return false;
 }
 
+Token LopDnsClient::getToken()
+{
+    return currentTokenState()->token;
+}
+
+void LopDnsClient::restoreToken(const std::string& client_id, const int durationInSeconds, const Token& token)
+{
+    publishToken(token, client_id, durationInSeconds);
+}
+
+void LopDnsClient::publishToken(const Token& token, const std::string& client_id, int durationInSeconds)
+{
+    std::shared_ptr<const TokenState> state = std::make_shared<const TokenState>(TokenState{token, client_id, durationInSeconds});
+    std::atomic_store_explicit(&tokenState, state, std::memory_order_release);
+}
+
+std::shared_ptr<const LopDnsClient::TokenState> LopDnsClient::currentTokenState() const
+{
+    return std::atomic_load_explicit(&tokenState, std::memory_order_acquire);
+}
+
+void LopDnsClient::setTokenRefreshMargin(int seconds)
+{
+    tokenRefreshMargin = std::max(seconds, 0);
+}
+
+// Authenticates again with the credentials of the state unless another thread replaced it
+// already. Concurrent callers wait for the same authentication.
+bool LopDnsClient::renewToken(const std::shared_ptr<const TokenState>& state)
+{
+    bool shared = false;
+    return *authentications.run(state->clientId, [this, state]() {
+        if (currentTokenState() != state) {
+            return true;
+        }
+        return authenticate(state->clientId, state->durationInSeconds);
+    }, shared);
+}
+
+void LopDnsClient::refreshTokenIfDue()
+{
+    std::shared_ptr<const TokenState> state = currentTokenState();
+    int margin = std::min(tokenRefreshMargin.load(), state->durationInSeconds / 2);
+    if (state->clientId.empty() || !state->token.epochExpires || margin <= 0) {
+        return;
+    }
+    long long now = time(nullptr);
+    if (now < state->token.epochExpires - margin) {
+        return;
+    }
+    if (now >= state->token.epochExpires) {
+        // Without a valid token every request has to wait for the new one
+        renewToken(state);
+        return;
+    }
+
+    // The token is still valid: one request renews it, the others go on with the current token
+    bool expected = false;
+    if (!refreshingToken.compare_exchange_strong(expected, true)) {
+        return;
+    }
+    LOG_DEBUG << "Token expires in " << state->token.epochExpires - now << " seconds, authenticating again.";
+    renewToken(state);
+    refreshingToken = false;
+}
+
+void LopDnsClient::setTokenListener(const std::function<void(const Token&)>& listener)
+{
+    this->tokenListener = listener;
+}
+
 bool LopDnsClient::isTokenExpired(const int minTimeLeftInSeconds)
 {
     // Implementation for checking if the token is expired
     auto current_time = int(time(nullptr));
-    if (!token.epochExpires)
+    long long epochExpires = getToken().epochExpires;
+    if (!epochExpires)
     {
         return true;
     }
-    return current_time > token.epochExpires - minTimeLeftInSeconds;
+    return current_time > epochExpires - minTimeLeftInSeconds;
 }
 
 bool LopDnsClient::validateToken()
@@ -71,11 +292,11 @@ bool LopDnsClient::validateToken()
     Response response = makeRestCall("GET", "/auth/validate");
     if (response.code >= 200 && response.code < 300)
     {
-        LOG_DEBUG << "Token validation successful. Response: " << response.body;
+        LOG_DEBUG << "Token validation successful. Response: " << truncateForLog(response.body, maxLoggedBodyLength);
         return true;
     }
     else {
-        LOG_ERROR << "Token validation call failed with code: " << response.code << " body: " << response.body;
+        LOG_ERROR << "Token validation call failed with code: " << response.code << " body: " << truncateForLog(response.body, maxLoggedBodyLength);
     }
 
     return false;
@@ -92,7 +313,7 @@ bool LopDnsClient::invalidateToken()
     Response response = makeRestCall("GET", "/auth/invalidate");
     if (response.code >= 200 && response.code < 300)
     {
-        LOG_DEBUG << "Token invalidation successful. Response: " << response.body;
+        LOG_DEBUG << "Token invalidation successful. Response: " << truncateForLog(response.body, maxLoggedBodyLength);
         return true;
     }
     else {
@@ -102,76 +323,200 @@ bool LopDnsClient::invalidateToken()
     return false;
 }
 
-std::list<std::string> LopDnsClient::getZones()
+// Runs a read, or waits for the identical read another thread is running
+template <typename Result, typename Fn>
+Result LopDnsClient::coalesce(SingleFlight<Result>& reads, const std::string& endpoint, Fn fn)
+{
+    bool shared = false;
+    auto result = reads.run(endpoint, fn, shared);
+    if (shared) {
+        metrics.increment("lopdns_coalesced_requests_total", {{"endpoint", endpointTemplate(endpoint)}});
+        LOG_DEBUG << "Shared the running request for " << endpoint << ".";
+    }
+    return SingleFlight<Result>::take(std::move(result));
+}
+
+std::vector<std::string> LopDnsClient::getZones()
+{
+    return coalesce(zoneReads, "/zones", [this]() { return fetchZones(); });
+}
+
+std::vector<Record> LopDnsClient::getRecords(const std::string& zone_name)
+{
+    auto records = coalesce(recordReads, "/records/" + zone_name, [this, &zone_name]() { return fetchRecords(zone_name); });
+    return records ? std::move(*records) : std::vector<Record>();
+}
+
+bool LopDnsClient::getRecords(const std::string& zone_name, std::vector<Record>& records)
+{
+    try
+    {
+        auto fetched = coalesce(recordReads, "/records/" + zone_name, [this, &zone_name]() { return fetchRecords(zone_name); });
+        if (!fetched) {
+            return false;
+        }
+        records = std::move(*fetched);
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERROR << "Invalid records of zone " << zone_name << ": " << e.what();
+    }
+    return false;
+}
+
+long long LopDnsClient::getCoalescedReads()
+{
+    return zoneReads.shared() + recordReads.shared();
+}
+
+std::vector<std::string> LopDnsClient::fetchZones()
 {
     // Implementation for getting the list of zones
     Response response = makeRestCall("GET", "/zones");
     if (response.code >= 200 && response.code < 300)
     {
-        // Parse response and return list of zones
-        std::list<std::string> zones;
-        json responseBody = json::parse(response.body);
-        if (responseBody.is_array()) {
-            zones.assign(responseBody.begin(), responseBody.end());
-        } else {
-            throw std::runtime_error("expected top-level array");
-        }
-        /*
-        for (const auto& zoneData : responseBody) {
-            std::cout << "Zone: " << zoneData.at("name").get<std::string>() << std::endl;
-            
-            zones.emplace_back(Zone{
-                zoneData.at("name").get<std::string>(),
-                zoneData.at("serial").get<int>(),
-                zoneData.at("refresh").get<int>(),
-                zoneData.at("retry").get<int>(),
-                zoneData.at("expire").get<int>(),
-                zoneData.at("minimum").get<int>()
-            });
-        */
+        // Decode the zone names straight from the response body
+        auto parseStart = std::chrono::steady_clock::now();
+        std::vector<std::string> zones = parseZoneList(response.view());
+        observeParse("/zones", parseStart);
         LOG_DEBUG << "Retrieved " << zones.size() << " zones.";
 
         return zones;
     }
     else {
-        LOG_ERROR << "Token validation call failed with code: " << response.code << " body: " << response.body;
+        LOG_ERROR << "Token validation call failed with code: " << response.code << " body: " << truncateForLog(response.body, maxLoggedBodyLength);
     }
 
     return {};
 }
 
-std::list<Record> LopDnsClient::getRecords(const std::string& zone_name)
+std::optional<std::vector<Record>> LopDnsClient::fetchRecords(const std::string& zone_name)
 {
     // Implementation for getting the list of records for a zone
-    Response response = makeRestCall("GET", "/records/" + zone_name);
+    bool fresh = false;
+    std::shared_ptr<const CachedZone> cached = recordCache ? recordCache->lookup(zone_name, fresh) : nullptr;
+    bool isCached = cached != nullptr;
+    Headers headers;
+    if (isCached) {
+        if (fresh) {
+            recordCache->countHit();
+            LOG_DEBUG << "Using " << cached->records.size() << " cached records for zone: " << zone_name;
+            return cached->records;
+        }
+        if (!cached->etag.empty()) {
+            headers["If-None-Match"] = cached->etag;
+        }
+        if (!cached->lastModified.empty()) {
+            headers["If-Modified-Since"] = cached->lastModified;
+        }
+    }
+
+    Response response = makeRestCall("GET", "/records/" + zone_name, true, headers);
+    if (response.code == 304 && isCached)
+    {
+        recordCache->markRevalidated(zone_name);
+        LOG_DEBUG << "Cached records for zone " << zone_name << " are not modified.";
+        return cached->records;
+    }
     if (response.code >= 200 && response.code < 300)
     {
-        // Parse response and return list of records
-        std::list<Record> records;
-        json responseBody = json::parse(response.body);
-        if (responseBody.is_array()) {
-            LOG_DEBUG << "Retrieved " << responseBody.size() << " records for zone: " << zone_name;
-        } else {
-            throw std::runtime_error("expected top-level array");
-        }
-        for (const auto& recordData : responseBody)
-        {
-            Record record;
-            record.name = recordData["name"];
-            record.type = recordData["type"];
-            record.content = recordData["content"];
-            record.ttl = recordData["ttl"].template get<int>();
-            record.priority = recordData["prio"].template get<int>();
-            records.push_back(record);
+        // Decode the records straight from the response body into a contiguous vector
+        auto parseStart = std::chrono::steady_clock::now();
+        std::vector<Record> records = parseRecordList(response.view());
+        observeParse("/records/" + zone_name, parseStart);
+        LOG_DEBUG << "Retrieved " << records.size() << " records for zone: " << zone_name;
+        if (recordCache) {
+            recordCache->countMiss();
+            recordCache->store(zone_name, records, getHeader(response.headers, "ETag"), getHeader(response.headers, "Last-Modified"));
         }
         return records;
     }
     else {
-        LOG_ERROR << "Token validation call failed with code: " << response.code << " body: " << response.body;
+        LOG_ERROR << "Token validation call failed with code: " << response.code << " body: " << truncateForLog(response.body, maxLoggedBodyLength);
     }
     return {};
 }
 
+bool LopDnsClient::forEachRecord(const std::string& zone_name, const std::function<bool(const Record&)>& callback)
+{
+    // Implementation for streaming the records of a zone
+    bool fresh = false;
+    std::shared_ptr<const CachedZone> cached = recordCache ? recordCache->lookup(zone_name, fresh) : nullptr;
+    bool isCached = cached != nullptr;
+    Headers headers;
+    if (isCached) {
+        if (fresh) {
+            recordCache->countHit();
+            LOG_DEBUG << "Using " << cached->records.size() << " cached records for zone: " << zone_name;
+            for (const auto& record : cached->records) {
+                if (!callback(record)) {
+                    break;
+                }
+            }
+            return true;
+        }
+        if (!cached->etag.empty()) {
+            headers["If-None-Match"] = cached->etag;
+        }
+        if (!cached->lastModified.empty()) {
+            headers["If-Modified-Since"] = cached->lastModified;
+        }
+    }
+
+    // The records are decoded from the pieces of the body as they arrive
+    RecordStreamParser parser(callback);
+    bool stopped = false;
+    std::string parseError;
+    Response response = makeRestCall("GET", "/records/" + zone_name, true, headers, QueryParams(), "",
+        [&parser, &stopped, &parseError](const char* data, size_t length) {
+            try
+            {
+                stopped = !parser.feed(std::string_view(data, length));
+            }
+            catch (const std::exception& e)
+            {
+                parseError = e.what();
+                return false;
+            }
+            return !stopped;
+        });
+    if (response.code == 304 && isCached)
+    {
+        recordCache->markRevalidated(zone_name);
+        LOG_DEBUG << "Cached records for zone " << zone_name << " are not modified.";
+        for (const auto& record : cached->records) {
+            if (!callback(record)) {
+                break;
+            }
+        }
+        return true;
+    }
+    if (response.code >= 200 && response.code < 300)
+    {
+        if (parseError.empty() && !stopped) {
+            try
+            {
+                parser.finish();
+            }
+            catch (const std::exception& e)
+            {
+                parseError = e.what();
+            }
+        }
+        if (!parseError.empty()) {
+            LOG_ERROR << "Invalid records of zone " << zone_name << ": " << parseError;
+            return false;
+        }
+        LOG_DEBUG << "Streamed " << parser.count() << " records for zone: " << zone_name << (stopped ? ", stopped early." : ".");
+        return true;
+    }
+    else {
+        LOG_ERROR << "Getting records call failed with code: " << response.code << " body: " << truncateForLog(response.body, maxLoggedBodyLength);
+    }
+    return false;
+}
+
 Record LopDnsClient::createRecord(const std::string& zone_name, const std::string& record_name,
                                    const std::string& type, const std::string& content, int ttl, int priority)
 {
@@ -184,16 +529,16 @@ Record LopDnsClient::createRecord(const std::string& zone_name, const std::strin
     bodyJson["priority"] = priority;
 
     Response response = makeRestCall("POST", "/records/" + zone_name, true, Headers(), QueryParams(), bodyJson.dump());
+    recordReads.forget("/records/" + zone_name);
     if (response.code >= 200 && response.code < 300)
     {
         // Parse response and return updated record
-        json responseBody = json::parse(response.body);
-        Record record;
-        record.name = responseBody["name"];
-        record.type = responseBody["type"];
-        record.content = responseBody["data"];
-        record.ttl = responseBody["ttl"];
-        record.priority = responseBody["priority"];
+        auto parseStart = std::chrono::steady_clock::now();
+        Record record = parseRecord(response.view());
+        observeParse("/records/" + zone_name, parseStart);
+        if (recordCache) {
+            recordCache->recordCreated(zone_name, record);
+        }
         return record;
     }
     else {
@@ -231,20 +576,20 @@ Record LopDnsClient::updateRecord(const std::string& zone_name, const std::strin
     }
     
     Response response = makeRestCall("PUT", "/records/" + zone_name, true, Headers(), QueryParams(), bodyJson.dump());
+    recordReads.forget("/records/" + zone_name);
     if (response.code >= 200 && response.code < 300)
     {
         // Parse response and return updated record
-        json responseBody = json::parse(response.body);
-        Record record;
-        record.name = responseBody["name"];
-        record.type = responseBody["type"];
-        record.content = responseBody["data"];
-        record.ttl = responseBody["ttl"];
-        record.priority = responseBody["priority"];
+        auto parseStart = std::chrono::steady_clock::now();
+        Record record = parseRecord(response.view());
+        observeParse("/records/" + zone_name, parseStart);
+        if (recordCache) {
+            recordCache->recordUpdated(zone_name, old_record_name, matching_type, old_content, record);
+        }
         return record;
     }
     else {
-        LOG_ERROR << "Token validation call failed with code: " << response.code << " body: " << response.body;
+        LOG_ERROR << "Token validation call failed with code: " << response.code << " body: " << truncateForLog(response.body, maxLoggedBodyLength);
     }
     return Record{};
 }
@@ -259,13 +604,17 @@ bool LopDnsClient::deleteRecord(const std::string& zone_name, const std::string&
     bodyJson["value"] = content;
 
     Response response = makeRestCall("DELETE", "/records/" + zone_name, true, Headers(), QueryParams(), bodyJson.dump());
+    recordReads.forget("/records/" + zone_name);
     if (response.code >= 200 && response.code < 300)
     {
-        LOG_DEBUG << "Record deleted successfully. Response: " << response.body;
+        LOG_DEBUG << "Record deleted successfully. Response: " << truncateForLog(response.body, maxLoggedBodyLength);
+        if (recordCache) {
+            recordCache->recordDeleted(zone_name, record_name, type, content);
+        }
         return true;
     }
     else {
-        LOG_ERROR << "Deleting record call failed with code: " << response.code << " body: " << response.body;
+        LOG_ERROR << "Deleting record call failed with code: " << response.code << " body: " << truncateForLog(response.body, maxLoggedBodyLength);
     }
 
     return false;
@@ -273,123 +622,173 @@ bool LopDnsClient::deleteRecord(const std::string& zone_name, const std::string&
 
 Response LopDnsClient::makeRestCall(const std::string& method, const std::string& endpoint, bool applyAuthHeaders,
                       const Headers& headers, const QueryParams& queryParams,
-                      const std::string& body)
+                      const std::string& body, const BodyReceiver& receiver)
 {
-    // Implementation for making a REST API call
-    std::string uri =  "/" + API_VERSION + endpoint;
-
-    std::stringstream logData;
-
-    logData << "Making " << method << " request to '" << url << "':";
-    logData << "\n\tURI: " << uri;
-
-    if (!queryParams.empty()) {
-        logData << "\n\tQuery Parameters:";
-        for (const auto& param : queryParams) {
-            logData << "\n\t\t" << param.first << ": " << param.second;
+    // Validating or invalidating a token does not need a fresh one
+    if (applyAuthHeaders && endpoint.compare(0, 6, "/auth/") != 0) {
+        refreshTokenIfDue();
+    }
+    std::shared_ptr<const TokenState> state = currentTokenState();
+    Response response = sendWithRetries(method, endpoint, applyAuthHeaders, headers, queryParams, body, receiver);
+
+    // A restored token may have been invalidated or expired in the meantime, authenticate once and repeat the call
+    if (response.code == 401 && applyAuthHeaders && !state->clientId.empty() && endpoint != "/auth/invalidate") {
+        LOG_WARNING << "Token rejected by the API, authenticating again.";
+        if (renewToken(state)) {
+            response = sendWithRetries(method, endpoint, applyAuthHeaders, headers, queryParams, body, receiver);
         }
     }
-    if (applyAuthHeaders) {
-        logData << "\n\tHeaders (auth):";
-        logData << "\n\t\tx-token: " << this->token.token;
-    }
-    if (headers.size() > 0) {
-        logData << "\n\tHeaders (additional):";
-        for (const auto& header : headers) {
-            logData << "\n\t\t" << header.first << ": " << header.second;
+    return response;
+}
+
+Response LopDnsClient::sendWithRetries(const std::string& method, const std::string& endpoint, bool applyAuthHeaders,
+                      const Headers& headers, const QueryParams& queryParams, const std::string& body,
+                      const BodyReceiver& receiver)
+{
+    // Once a part of the body was handed to the receiver, repeating the request would hand it out again
+    bool received = false;
+    BodyReceiver trackingReceiver;
+    if (receiver) {
+        trackingReceiver = [&receiver, &received](const char* data, size_t length) {
+            received = true;
+            return receiver(data, length);
+        };
+    }
+    for (int attempt = 1; ; attempt++) {
+        Response response = sendRestCall(method, endpoint, applyAuthHeaders, headers, queryParams, body, trackingReceiver);
+        if (received || !retryPolicy->shouldRetry(method, response.code, attempt)) {
+            return response;
         }
+        auto delay = retryPolicy->delayFor(attempt, getHeader(response.headers, "Retry-After"));
+        if (delay.count() < 0) {
+            LOG_WARNING << method << " " << endpoint << " asked to retry after "
+                        << getHeader(response.headers, "Retry-After") << ", not retrying.";
+            return response;
+        }
+        std::string reason = response.code < 0 ? "connection" : std::to_string(response.code);
+        metrics.increment("lopdns_retries_total", {{"method", method}, {"endpoint", endpointTemplate(endpoint)},
+                                                   {"reason", reason}});
+        LOG_WARNING << method << " " << endpoint << " failed (" << (response.code < 0 ? response.body : reason)
+                    << "), retrying in " << delay.count() << " ms (attempt " << attempt + 1 << " of "
+                    << retryPolicy->getSettings().maxAttempts << ").";
+        std::this_thread::sleep_for(delay);
     }
-    if (!body.empty()) {
-        logData << "\n\tBody: " << body;
-    }
-    LOG_DEBUG << logData.str();
-
-
-    httplib::Result httpResult;
-    httplib::SSLClient client(url.c_str());
+}
 
-    try
-    {
+Response LopDnsClient::sendRestCall(const std::string& method, const std::string& endpoint, bool applyAuthHeaders,
+                      const Headers& headers, const QueryParams& queryParams,
+                      const std::string& body, const BodyReceiver& receiver)
+{
+    // Implementation for making a REST API call
+    std::string uri =  "/" + API_VERSION + endpoint;
+    std::string tokenValue = applyAuthHeaders ? getToken().token : "";
 
-        LOG_DEBUG << "Setting timeouts to " << timeout << " seconds.";
-        client.set_connection_timeout(timeout, 0); 
-        client.set_read_timeout(timeout, 0); // 5 seconds
-        client.set_write_timeout(timeout, 0); // 5 seconds
+    // The request dump is only built if it is logged
+    if (isLogEnabled(plog::debug)) {
+        std::stringstream logData;
 
-        LOG_DEBUG << "Setting connection properties ";
-        client.set_follow_location(true);
-        client.enable_server_certificate_verification(true);
+        logData << "Making " << method << " request to '" << url << "':";
+        logData << "\n\tURI: " << uri;
 
-        LOG_DEBUG << "Preparing HTTP " << method << " request to '" << client.host() << uri << "' on port " << client.port();
-        LOG_DEBUG << "Adding headers";
-        httplib::Headers httpHeaders;
-        for (const auto& header : headers) {
-            httpHeaders.insert(header);
+        if (!queryParams.empty()) {
+            logData << "\n\tQuery Parameters:";
+            for (const auto& param : queryParams) {
+                logData << "\n\t\t" << param.first << ": "
+                        << (isSecretParameter(param.first) ? redactSecret(param.second) : param.second);
+            }
         }
         if (applyAuthHeaders) {
-            httpHeaders.insert({"x-token", this->token.token});
+            logData << "\n\tHeaders (auth):";
+            logData << "\n\t\tx-token: " << redactSecret(tokenValue);
         }
-        httpHeaders.insert({"User-Agent", USER_AGENT.c_str()});
-        
-        LOG_DEBUG << "Adding parameters";
-        httplib::Params httpParams;
-        for (const auto& param : queryParams) {
-            httpParams.insert(param);
+        if (headers.size() > 0) {
+            logData << "\n\tHeaders (additional):";
+            for (const auto& header : headers) {
+                logData << "\n\t\t" << header.first << ": "
+                        << (isSecretParameter(header.first) ? redactSecret(header.second) : header.second);
+            }
         }
-        
-        LOG_DEBUG << "Sending HTTP " << method << " request";
-        if (method == "GET") {
-            httpResult = client.Get(uri, httpParams, httpHeaders);
-        } else if (method == "POST") {
-            httpResult = body.empty() ? client.Post(uri, httpHeaders, httpParams) : client.Post(uri, httpHeaders, body, ENCODING);
-        } else if (method == "PUT") {
-            httpResult = body.empty() ? client.Put(uri, httpHeaders, httpParams) : client.Put(uri, httpHeaders, body, ENCODING);
-        } else if (method == "PATCH") {
-            httpResult = body.empty() ? client.Patch(uri, httpHeaders, httpParams) : client.Patch(uri, httpHeaders, body, ENCODING);
-        } else if (method == "DELETE") {
-            httpResult = body.empty() ? client.Delete(uri, httpHeaders, httpParams) : client.Delete(uri, httpHeaders, body, ENCODING);
-        } else {
-            throw std::runtime_error("Unsupported HTTP method: " + method);
+        if (!body.empty()) {
+            logData << "\n\tBody: " << truncateForLog(body, maxLoggedBodyLength);
         }
+        LOG_DEBUG << logData.str();
     }
-    catch(const std::exception& e)
-    {
-        std::cerr << e.what() << '\n';
-        throw;
-    }
-
-    Response response;
-    response.code = -1;
 
-    if (!httpResult) {
-        auto err = httplib::to_string(httpResult.error());
-        LOG_ERROR << "HTTP request failed: " << err;
-        auto sslResult = client.get_openssl_verify_result();
-        if (sslResult) {
-            LOG_ERROR << "SSL verify error: " << X509_verify_cert_error_string(sslResult);
-        }
-        response.body = err;
+    TransportRequest request;
+    request.method = method;
+    request.uri = uri;
+    request.headers = headers;
+    if (applyAuthHeaders) {
+        request.headers["x-token"] = tokenValue;
+    }
+    request.headers["User-Agent"] = USER_AGENT;
+    request.queryParams = queryParams;
+    request.body = body;
+    request.contentType = ENCODING;
+    long long streamedBytes = 0;
+    if (receiver) {
+        request.bodyReceiver = [&receiver, &streamedBytes](const char* data, size_t length) {
+            streamedBytes += static_cast<long long>(length);
+            return receiver(data, length);
+        };
+    }
+
+    std::string endpointName = endpointTemplate(endpoint);
+    auto requestStart = std::chrono::steady_clock::now();
+    TransportResult result = transport->send(request);
+    metrics.observe("lopdns_connection_wait_seconds", {{"method", method}, {"endpoint", endpointName}}, result.connectionWaitSeconds);
+
+    // A new connection includes the TCP connect and TLS handshake in the request time
+    MetricLabels timingLabels = {{"method", method}, {"endpoint", endpointName},
+                                 {"connection", result.reusedConnection ? "reused" : "new"}};
+    double requestSeconds = secondsSince(requestStart) - result.connectionWaitSeconds;
+    metrics.observe("lopdns_request_duration_seconds", timingLabels, requestSeconds);
+    if (result.firstByteSeconds.has_value()) {
+        metrics.observe("lopdns_time_to_first_byte_seconds", timingLabels, result.firstByteSeconds.value());
+        metrics.observe("lopdns_body_transfer_seconds", timingLabels, requestSeconds - result.firstByteSeconds.value());
+    }
+
+    Response response = std::move(result.response);
+    if (response.code < 0) {
+        metrics.increment("lopdns_requests_total", {{"method", method}, {"endpoint", endpointName}, {"status", "error"}});
         return response;
     }
 
-    LOG_DEBUG << "Handling HTTP response";
-    response.code = httpResult->status;
-    response.body = httpResult->body;
+    metrics.increment("lopdns_requests_total", {{"method", method}, {"endpoint", endpointName},
+                                                {"status", std::to_string(response.code)}});
+    long long bodyBytes = static_cast<long long>(response.body.size()) + streamedBytes;
+    metrics.increment("lopdns_response_bytes_total", {{"method", method}, {"endpoint", endpointName}}, bodyBytes);
+    metrics.increment("lopdns_response_wire_bytes_total", {{"method", method}, {"endpoint", endpointName}},
+                      result.wireBytes < 0 ? bodyBytes : result.wireBytes);
 
-    logResponse(uri, method, httpResult);
+    logResponse(uri, method, response);
 
     return response;
 }
 
-void LopDnsClient::logResponse(const std::string& uri, const std::string& method, const httplib::Result& httpResult)
+void LopDnsClient::observeParse(const std::string& endpoint, const std::chrono::steady_clock::time_point& start)
 {
+    metrics.observe("lopdns_parse_duration_seconds", {{"endpoint", endpointTemplate(endpoint)}}, secondsSince(start));
+}
+
+void LopDnsClient::logResponse(const std::string& uri, const std::string& method, const Response& response)
+{
+    if (!isLogEnabled(response.code >= 400 ? plog::error : plog::debug)) {
+        return;
+    }
     std::stringstream logData;
-    logData << "Response Code: " << httpResult->status << "\n";
-    logData << "Response Body: " << httpResult->body << "\n";
-    for (const auto& header : httpResult->headers) {
+    logData << "Response to " << method << " " << uri << "\n";
+    logData << "Response Code: " << response.code << "\n";
+    // The token response carries the token itself
+    if (uri.size() >= 11 && uri.compare(uri.size() - 11, 11, "/auth/token") == 0) {
+        logData << "Response Body: <redacted>\n";
+    } else {
+        logData << "Response Body: " << truncateForLog(response.body, maxLoggedBodyLength) << "\n";
+    }
+    for (const auto& header : response.headers) {
         logData << "Response Header: " << header.first << ": " << header.second << "\n";
     }
-    if (httpResult->status >= 400) {
+    if (response.code >= 400) {
         LOG_ERROR << logData.str();
     } else {
         LOG_DEBUG << logData.str();
@@ -2,11 +2,21 @@
 #define LOPDNSCLIENT_H
 
 #include <string>
+#include <string_view>
 #include <list>
+#include <vector>
 #include <optional>
 #include <map>
-#define CPPHTTPLIB_OPENSSL_SUPPORT
-#include "httplib.h"
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "transport.h"
+#include "recordcache.h"
+#include "metrics.h"
+#include "retrypolicy.h"
+#include "workerpool.h"
+#include "singleflight.h"
 
 typedef struct Zone
 {
@@ -35,19 +45,13 @@ typedef struct Token
     std::string tzone;
 } Token;
 
-typedef struct Response
-{
-    int code;
-    std::string body;
-} Response;
-
-typedef std::map<std::string, std::string> Headers;
-typedef std::map<std::string, std::string> QueryParams;
-
 class LopDnsClient
 {
 public:
-    LopDnsClient(const std::string& url = "https://api.lopdns.se/v2", int timeoutInSeconds = 10);
+    LopDnsClient(const std::string& url = "https://api.lopdns.se/v2", int timeoutInSeconds = 10,
+                 const ConnectionPoolSettings& poolSettings = ConnectionPoolSettings());
+    // Sends the requests through the given backend instead of cpp-httplib, e.g. a FakeTransport
+    explicit LopDnsClient(std::unique_ptr<Transport> transport);
     ~LopDnsClient();
 
     // Methods for interacting with the API
@@ -55,8 +59,26 @@ public:
     bool isTokenExpired(const int minTimeLeftInSeconds = 0);
     bool validateToken();
     bool invalidateToken();
-    std::list<std::string> getZones();
-    std::list<Record> getRecords(const std::string& zone_name);
+    Token getToken();
+    // Uses a token obtained earlier, e.g. from a TokenStore, instead of authenticating. The
+    // client id and duration are used to authenticate again if the token is rejected.
+    void restoreToken(const std::string& client_id, const int durationInSeconds, const Token& token);
+    // Called with every new token from authenticate
+    void setTokenListener(const std::function<void(const Token&)>& listener);
+    // Requests made within this many seconds before the token expires authenticate again first,
+    // at most half of the token duration. One request renews the token while the others keep
+    // using the current one. Defaults to 60 seconds, 0 disables it.
+    void setTokenRefreshMargin(int seconds);
+    std::vector<std::string> getZones();
+    std::vector<Record> getRecords(const std::string& zone_name);
+    // Like getRecords, but tells a failed or undecodable fetch from an empty zone. Returns false
+    // and leaves records untouched if the records could not be fetched or decoded.
+    bool getRecords(const std::string& zone_name, std::vector<Record>& records);
+    // Passes the records of a zone to the callback one by one while the response is still being
+    // received, without keeping the zone in memory. The callback returns false to stop early.
+    // Returns false if the records could not be fetched or decoded, records passed before the
+    // error stay passed. Uses the record cache if it is fresh or confirmed, but does not fill it.
+    bool forEachRecord(const std::string& zone_name, const std::function<bool(const Record&)>& callback);
     Record createRecord(
         const std::string& zone_name,
         const std::string& record_name,
@@ -77,15 +99,117 @@ public:
     bool deleteRecord(const std::string& zone_name, const std::string& record_name,
                                         const std::string& type, const std::string& content);
 
+    // getZones and getRecords calls that were answered by an identical call already running on
+    // another thread. A write to a zone ends the sharing of its running read, callers that
+    // read after the write get a new request.
+    long long getCoalescedReads();
+
+    // Connection reuse counters of the transport
+    ConnectionPoolStats getConnectionPoolStats();
+
+    // Keeps the records of every fetched zone, see RecordCache. Disabled by default.
+    void enableRecordCache(int freshnessInSeconds);
+    void disableRecordCache();
+    RecordCacheStats getRecordCacheStats();
+
+    // Asynchronous variants of the calls above. They run on an internal pool of threads that is
+    // started on the first call, the futures rethrow the exceptions of the calls. A call whose
+    // cancellation token is cancelled before it starts throws OperationCancelled from the future.
+    // setAsyncThreadCount must be called before the first asynchronous call.
+    void setAsyncThreadCount(int threadCount);
+    std::future<std::vector<std::string>> getZonesAsync(const CancellationToken& cancellation = CancellationToken());
+    std::future<std::vector<Record>> getRecordsAsync(const std::string& zone_name,
+                                                     const CancellationToken& cancellation = CancellationToken());
+    std::future<Record> createRecordAsync(
+        const std::string& zone_name,
+        const std::string& record_name,
+        const std::string& type,
+        const std::string& content,
+        int ttl = 3600,
+        int priority = 0,
+        const CancellationToken& cancellation = CancellationToken());
+    std::future<Record> updateRecordAsync(
+        const std::string& zone_name,
+        const std::string& old_record_name,
+        const std::string& matching_type,
+        const std::string& old_content,
+        const std::optional<std::string>& new_record_name,
+        const std::optional<std::string>& new_type,
+        const std::optional<std::string>& new_content,
+        const std::optional<int>& new_ttl,
+        const std::optional<int>& new_priority,
+        const CancellationToken& cancellation = CancellationToken());
+    std::future<bool> deleteRecordAsync(const std::string& zone_name, const std::string& record_name,
+                                        const std::string& type, const std::string& content,
+                                        const CancellationToken& cancellation = CancellationToken());
+
+    // Failed requests are retried according to the policy, see RetryPolicy
+    void setRetrySettings(const RetrySettings& settings);
+
+    // Request counters and latency histograms, labeled by method, endpoint template and status
+    MetricsRegistry& getMetrics() { return metrics; }
+
 private:
-    Token token;
+    // A token with the credentials to replace it. A state is never changed once it is published,
+    // requests read the current one with std::atomic_load and no client lock. A replaced state is
+    // freed once the last request holding it is done.
+    typedef struct TokenState
+    {
+        Token token;
+        std::string clientId;
+        int durationInSeconds;
+    } TokenState;
+    std::shared_ptr<const TokenState> tokenState;
+    std::atomic<bool> refreshingToken{false};
+    std::atomic<int> tokenRefreshMargin{60};
+    SingleFlight<bool> authentications;
+    std::function<void(const Token&)> tokenListener;
     std::string url;
-    int timeout;
+    std::unique_ptr<Transport> transport;
+    std::unique_ptr<RecordCache> recordCache;
+    MetricsRegistry metrics;
+    std::unique_ptr<RetryPolicy> retryPolicy;
+    SingleFlight<std::vector<std::string>> zoneReads;
+    // Empty if the fetch failed
+    SingleFlight<std::optional<std::vector<Record>>> recordReads;
+    // Declared last so that its threads are joined before the members they use are destroyed
+    std::unique_ptr<WorkerPool> asyncPool;
+    int asyncThreadCount = 4;
+    std::mutex asyncPoolMutex;
+    WorkerPool& getAsyncPool();
+
+    template <typename Fn>
+    auto runAsync(const CancellationToken& cancellation, Fn fn) -> std::future<decltype(fn())>
+    {
+        return getAsyncPool().submit([cancellation, fn]() {
+            if (cancellation.isCancelled()) {
+                throw OperationCancelled();
+            }
+            return fn();
+        });
+    }
+    void publishToken(const Token& token, const std::string& client_id, int durationInSeconds);
+    void refreshTokenIfDue();
+    std::shared_ptr<const TokenState> currentTokenState() const;
+    bool renewToken(const std::shared_ptr<const TokenState>& state);
+    std::vector<std::string> fetchZones();
+    std::optional<std::vector<Record>> fetchRecords(const std::string& zone_name);
+
+    template <typename Result, typename Fn>
+    Result coalesce(SingleFlight<Result>& reads, const std::string& endpoint, Fn fn);
     Response makeRestCall(const std::string& method, const std::string& endpoint, bool applyAuthHeaders = true,
                       const Headers& headers = Headers(),
                       const QueryParams& queryParams = QueryParams(),
-                      const std::string& body = "");
-    void logResponse(const std::string& uri, const std::string& method, const httplib::Result& response);
+                      const std::string& body = "",
+                      const BodyReceiver& receiver = BodyReceiver());
+    Response sendWithRetries(const std::string& method, const std::string& endpoint, bool applyAuthHeaders,
+                      const Headers& headers, const QueryParams& queryParams, const std::string& body,
+                      const BodyReceiver& receiver);
+    Response sendRestCall(const std::string& method, const std::string& endpoint, bool applyAuthHeaders,
+                      const Headers& headers, const QueryParams& queryParams, const std::string& body,
+                      const BodyReceiver& receiver);
+    void logResponse(const std::string& uri, const std::string& method, const Response& response);
+    void observeParse(const std::string& endpoint, const std::chrono::steady_clock::time_point& start);
 };
 
 #endif // LOPDNSCLIENT_H
\ No newline at end of file
@@ -0,0 +1,274 @@
+#include "nlohmann/json.hpp"
+#include "logging.h"
+
+#include "metrics.h"
+// httplib with the configuration used by the client
+#include "connectionpool.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+
+using json = nlohmann::json;
+
+double secondsSince(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string escapeLabelValue(const std::string& value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static std::string formatLabels(const MetricLabels& labels, const std::string& le = "")
+{
+    if (labels.empty() && le.empty()) {
+        return "";
+    }
+    std::string text = "{";
+    for (const auto& label : labels) {
+        if (text.size() > 1) {
+            text += ",";
+        }
+        text += label.first + "=\"" + escapeLabelValue(label.second) + "\"";
+    }
+    if (!le.empty()) {
+        if (text.size() > 1) {
+            text += ",";
+        }
+        text += "le=\"" + le + "\"";
+    }
+    return text + "}";
+}
+
+static std::string formatNumber(double value)
+{
+    std::ostringstream text;
+    text << std::setprecision(9) << value;
+    return text.str();
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+}
+
+const std::vector<double>& MetricsRegistry::bucketBounds()
+{
+    static const std::vector<double> bounds = {0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0};
+    return bounds;
+}
+
+void MetricsRegistry::increment(const std::string& name, const MetricLabels& labels, long long value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    counters[name][labels] += value;
+}
+
+void MetricsRegistry::observe(const std::string& name, const MetricLabels& labels, double seconds)
+{
+    const auto& bounds = bucketBounds();
+    size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), seconds) - bounds.begin();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    HistogramData& data = histograms[name][labels];
+    if (data.buckets.empty()) {
+        data.buckets.assign(bounds.size() + 1, 0);
+    }
+    data.buckets[bucket]++;
+    data.count++;
+    data.sum += seconds;
+}
+
+long long MetricsRegistry::counter(const std::string& name, const MetricLabels& labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = counters.find(name);
+    if (it == counters.end()) {
+        return 0;
+    }
+    auto value = it->second.find(labels);
+    return value == it->second.end() ? 0 : value->second;
+}
+
+HistogramData MetricsRegistry::histogram(const std::string& name, const MetricLabels& labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = histograms.find(name);
+    if (it == histograms.end()) {
+        return HistogramData();
+    }
+    auto data = it->second.find(labels);
+    return data == it->second.end() ? HistogramData() : data->second;
+}
+
+void MetricsRegistry::merge(MetricsRegistry& other, const MetricLabels& extraLabels)
+{
+    std::map<std::string, std::map<MetricLabels, long long>> otherCounters;
+    std::map<std::string, std::map<MetricLabels, HistogramData>> otherHistograms;
+    {
+        std::lock_guard<std::mutex> lock(other.mutex);
+        otherCounters = other.counters;
+        otherHistograms = other.histograms;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& metric : otherCounters) {
+        for (const auto& series : metric.second) {
+            MetricLabels labels = series.first;
+            labels.insert(extraLabels.begin(), extraLabels.end());
+            counters[metric.first][labels] += series.second;
+        }
+    }
+    for (const auto& metric : otherHistograms) {
+        for (const auto& series : metric.second) {
+            MetricLabels labels = series.first;
+            labels.insert(extraLabels.begin(), extraLabels.end());
+            HistogramData& data = histograms[metric.first][labels];
+            if (data.buckets.empty()) {
+                data.buckets.assign(series.second.buckets.size(), 0);
+            }
+            for (size_t i = 0; i < data.buckets.size() && i < series.second.buckets.size(); i++) {
+                data.buckets[i] += series.second.buckets[i];
+            }
+            data.count += series.second.count;
+            data.sum += series.second.sum;
+        }
+    }
+}
+
+std::string MetricsRegistry::toPrometheus()
+{
+    const auto& bounds = bucketBounds();
+    std::ostringstream text;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& metric : counters) {
+        text << "# TYPE " << metric.first << " counter\n";
+        for (const auto& series : metric.second) {
+            text << metric.first << formatLabels(series.first) << " " << series.second << "\n";
+        }
+    }
+    for (const auto& metric : histograms) {
+        text << "# TYPE " << metric.first << " histogram\n";
+        for (const auto& series : metric.second) {
+            const HistogramData& data = series.second;
+            long long cumulative = 0;
+            for (size_t i = 0; i < bounds.size(); i++) {
+                cumulative += data.buckets[i];
+                text << metric.first << "_bucket" << formatLabels(series.first, formatNumber(bounds[i])) << " " << cumulative << "\n";
+            }
+            text << metric.first << "_bucket" << formatLabels(series.first, "+Inf") << " " << data.count << "\n";
+            text << metric.first << "_sum" << formatLabels(series.first) << " " << formatNumber(data.sum) << "\n";
+            text << metric.first << "_count" << formatLabels(series.first) << " " << data.count << "\n";
+        }
+    }
+    return text.str();
+}
+
+std::string MetricsRegistry::toJson()
+{
+    const auto& bounds = bucketBounds();
+    json data;
+    data["counters"] = json::array();
+    data["histograms"] = json::array();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& metric : counters) {
+        for (const auto& series : metric.second) {
+            data["counters"].push_back({{"name", metric.first}, {"labels", series.first}, {"value", series.second}});
+        }
+    }
+    for (const auto& metric : histograms) {
+        for (const auto& series : metric.second) {
+            json buckets = json::array();
+            for (size_t i = 0; i < series.second.buckets.size(); i++) {
+                json le = i < bounds.size() ? json(bounds[i]) : json("+Inf");
+                buckets.push_back({{"le", le}, {"count", series.second.buckets[i]}});
+            }
+            data["histograms"].push_back({{"name", metric.first}, {"labels", series.first},
+                                          {"count", series.second.count}, {"sum", series.second.sum},
+                                          {"buckets", buckets}});
+        }
+    }
+    return data.dump(2);
+}
+
+bool MetricsRegistry::writeFile(const std::string& path)
+{
+    bool asJson = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    std::string content = asJson ? toJson() : toPrometheus();
+
+    // Replace the file atomically so that scrapers never read a partial file
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::trunc);
+        if (!file || !(file << content)) {
+            LOG_ERROR << "Failed to write metrics file " << temporaryPath;
+            return false;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        LOG_ERROR << "Failed to replace metrics file " << path;
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Implementation for MetricsEndpoint
+
+struct MetricsEndpoint::Server
+{
+    httplib::Server http;
+};
+
+MetricsEndpoint::MetricsEndpoint(MetricsRegistry& registry)
+    : registry(registry)
+{
+}
+
+MetricsEndpoint::~MetricsEndpoint()
+{
+    stop();
+}
+
+bool MetricsEndpoint::start(const std::string& address, int port)
+{
+    server = std::make_unique<Server>();
+    server->http.Get("/metrics", [this](const httplib::Request&, httplib::Response& response) {
+        response.set_content(registry.toPrometheus(), "text/plain; version=0.0.4");
+    });
+    if (!server->http.bind_to_port(address, port)) {
+        LOG_ERROR << "Failed to listen for metrics on " << address << ":" << port;
+        server.reset();
+        return false;
+    }
+    listener = std::thread([this]() {
+        server->http.listen_after_bind();
+    });
+    LOG_INFO << "Serving metrics on http://" << address << ":" << port << "/metrics";
+    return true;
+}
+
+void MetricsEndpoint::stop()
+{
+    if (server) {
+        server->http.stop();
+    }
+    if (listener.joinable()) {
+        listener.join();
+    }
+    server.reset();
+}
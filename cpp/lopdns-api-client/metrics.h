@@ -0,0 +1,70 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <chrono>
+
+typedef std::map<std::string, std::string> MetricLabels;
+
+typedef struct HistogramData
+{
+    // Counts per upper bound, not cumulative, the last bucket is +Inf
+    std::vector<long long> buckets;
+    long long count = 0;
+    double sum = 0.0;
+} HistogramData;
+
+// Counters and latency histograms keyed by name and labels. All methods are thread safe.
+class MetricsRegistry
+{
+public:
+    MetricsRegistry();
+
+    void increment(const std::string& name, const MetricLabels& labels, long long value = 1);
+    void observe(const std::string& name, const MetricLabels& labels, double seconds);
+
+    long long counter(const std::string& name, const MetricLabels& labels);
+    HistogramData histogram(const std::string& name, const MetricLabels& labels);
+    // Adds all series of another registry with additional labels, e.g. to combine several clients
+    void merge(MetricsRegistry& other, const MetricLabels& extraLabels);
+
+    // Prometheus text exposition format
+    std::string toPrometheus();
+    std::string toJson();
+    // Writes JSON if the path ends with .json and Prometheus text otherwise
+    bool writeFile(const std::string& path);
+
+    // Upper bounds of the histogram buckets in seconds
+    static const std::vector<double>& bucketBounds();
+
+private:
+    std::map<std::string, std::map<MetricLabels, long long>> counters;
+    std::map<std::string, std::map<MetricLabels, HistogramData>> histograms;
+    std::mutex mutex;
+};
+
+// Serves the metrics of a registry as Prometheus text on GET /metrics
+class MetricsEndpoint
+{
+public:
+    explicit MetricsEndpoint(MetricsRegistry& registry);
+    ~MetricsEndpoint();
+
+    bool start(const std::string& address, int port);
+    void stop();
+
+private:
+    struct Server;
+    MetricsRegistry& registry;
+    std::unique_ptr<Server> server;
+    std::thread listener;
+};
+
+double secondsSince(const std::chrono::steady_clock::time_point& start);
+
+#endif // METRICS_H
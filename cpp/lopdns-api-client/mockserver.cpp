@@ -0,0 +1,70 @@
+#include "logging.h"
+
+#include "mockserver.h"
+
+MockLopDnsServer::MockLopDnsServer(const SimulationSettings& settings)
+    : simulation(settings)
+{
+    auto handler = [this](const httplib::Request& request, httplib::Response& response) {
+        handle(request, response);
+    };
+    server.Get(".*", handler);
+    server.Post(".*", handler);
+    server.Put(".*", handler);
+    server.Delete(".*", handler);
+}
+
+MockLopDnsServer::~MockLopDnsServer()
+{
+    stop();
+}
+
+int MockLopDnsServer::start(const std::string& address)
+{
+    this->address = address;
+    port = server.bind_to_any_port(address);
+    if (port < 0) {
+        LOG_ERROR << "Mock server failed to bind to " << address;
+        return -1;
+    }
+    listener = std::thread([this]() { server.listen_after_bind(); });
+    server.wait_until_ready();
+    LOG_DEBUG << "Mock server listening on " << url();
+    return port;
+}
+
+void MockLopDnsServer::stop()
+{
+    if (listener.joinable()) {
+        server.stop();
+        listener.join();
+    }
+}
+
+std::string MockLopDnsServer::url() const
+{
+    return "http://" + address + ":" + std::to_string(port);
+}
+
+void MockLopDnsServer::handle(const httplib::Request& request, httplib::Response& response)
+{
+    Headers headers;
+    for (const auto& header : request.headers) {
+        headers.insert(header);
+    }
+    QueryParams queryParams;
+    for (const auto& param : request.params) {
+        queryParams.insert(param);
+    }
+
+    Response answer = simulation.handle(request.method, request.path, headers, queryParams, request.body);
+    response.status = answer.code;
+    for (const auto& header : answer.headers) {
+        if (header.first != "Content-Type") {
+            response.set_header(header.first, header.second);
+        }
+    }
+    if (!answer.body.empty()) {
+        response.set_content(answer.body, answer.headers["Content-Type"]);
+    }
+}
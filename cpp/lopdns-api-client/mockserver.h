@@ -0,0 +1,36 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include "apisimulation.h"
+
+// A local HTTP server that answers the requests of LopDnsClient from a LopDnsApiSimulation
+class MockLopDnsServer
+{
+public:
+    explicit MockLopDnsServer(const SimulationSettings& settings = SimulationSettings());
+    ~MockLopDnsServer();
+
+    // Listens on an ephemeral port of the address and returns the port, or -1 on failure
+    int start(const std::string& address = "127.0.0.1");
+    void stop();
+
+    // Base URL to hand to LopDnsClient
+    std::string url() const;
+    long long requestCount() const { return simulation.requestCount(); }
+    std::vector<std::string> zoneNames() { return simulation.zoneNames(); }
+    LopDnsApiSimulation& getSimulation() { return simulation; }
+
+private:
+    void handle(const httplib::Request& request, httplib::Response& response);
+
+    LopDnsApiSimulation simulation;
+    httplib::Server server;
+    std::thread listener;
+    std::string address;
+    int port = -1;
+};
+
+#endif // MOCKSERVER_H
@@ -0,0 +1,244 @@
+#include "nlohmann/json.hpp"
+#include "logging.h"
+
+#include "reconcile.h"
+#include "workerpool.h"
+#include <unordered_map>
+#include <algorithm>
+
+using json = nlohmann::json;
+
+constexpr int defaultDesiredRecordTtl = 3600;
+constexpr int defaultDesiredRecordPriority = 0;
+
+DesiredState readDesiredState(std::istream& input)
+{
+    json data;
+    try
+    {
+        data = json::parse(input);
+    }
+    catch (const json::exception& e)
+    {
+        throw std::runtime_error(std::string("invalid desired-state file: ") + e.what());
+    }
+    if (!data.is_object()) {
+        throw std::runtime_error("invalid desired-state file: expected an object with an array of records per zone");
+    }
+
+    DesiredState desiredState;
+    for (const auto& zone : data.items()) {
+        if (!zone.value().is_array()) {
+            throw std::runtime_error("invalid desired-state file: records of zone '" + zone.key() + "' must be an array");
+        }
+        std::vector<Record>& records = desiredState[zone.key()];
+        records.reserve(zone.value().size());
+        for (const auto& item : zone.value()) {
+            try
+            {
+                Record record;
+                record.name = item.at("name").get<std::string>();
+                record.type = item.at("type").get<std::string>();
+                record.content = item.at("content").get<std::string>();
+                record.ttl = item.value("ttl", defaultDesiredRecordTtl);
+                record.priority = item.value("priority", defaultDesiredRecordPriority);
+                records.push_back(record);
+            }
+            catch (const json::exception& e)
+            {
+                throw std::runtime_error("invalid desired-state file: record " + std::to_string(records.size())
+                                         + " of zone '" + zone.key() + "': " + e.what());
+            }
+        }
+    }
+    return desiredState;
+}
+
+static std::string recordKey(const Record& record)
+{
+    std::string key;
+    key.reserve(record.name.size() + record.type.size() + record.content.size() + 2);
+    key.append(record.name).append(1, '\0').append(record.type).append(1, '\0').append(record.content);
+    return key;
+}
+
+static std::string nameTypeKey(const Record& record)
+{
+    return record.name + '\0' + record.type;
+}
+
+ChangeSet computeChangeSet(const std::string& zone, const std::vector<Record>& live, const std::vector<Record>& desired)
+{
+    ChangeSet changeSet;
+    changeSet.zone = zone;
+    std::vector<RecordChange> updates;
+    std::vector<RecordChange> creates;
+    std::vector<RecordChange> deletes;
+
+    // Unmatched desired records per key, in reverse so that the first one is taken from the back
+    std::unordered_map<std::string, std::vector<size_t>> desiredByKey;
+    desiredByKey.reserve(desired.size());
+    for (size_t i = desired.size(); i-- > 0;) {
+        desiredByKey[recordKey(desired[i])].push_back(i);
+    }
+    std::vector<bool> desiredMatched(desired.size(), false);
+    std::vector<size_t> unmatchedLive;
+
+    for (size_t i = 0; i < live.size(); i++) {
+        auto it = desiredByKey.find(recordKey(live[i]));
+        if (it == desiredByKey.end() || it->second.empty()) {
+            unmatchedLive.push_back(i);
+            continue;
+        }
+        const Record& target = desired[it->second.back()];
+        desiredMatched[it->second.back()] = true;
+        it->second.pop_back();
+        if (target.ttl != live[i].ttl || target.priority != live[i].priority) {
+            updates.push_back(RecordChange{RECORD_UPDATE, live[i], target});
+        } else {
+            changeSet.unchanged++;
+        }
+    }
+
+    // Content that moved within a name and type becomes an update instead of a delete and a create
+    std::unordered_map<std::string, std::vector<size_t>> unmatchedDesiredByNameType;
+    for (size_t i = desired.size(); i-- > 0;) {
+        if (!desiredMatched[i]) {
+            unmatchedDesiredByNameType[nameTypeKey(desired[i])].push_back(i);
+        }
+    }
+    for (size_t i : unmatchedLive) {
+        auto it = unmatchedDesiredByNameType.find(nameTypeKey(live[i]));
+        if (it == unmatchedDesiredByNameType.end() || it->second.empty()) {
+            deletes.push_back(RecordChange{RECORD_DELETE, live[i], Record{}});
+            continue;
+        }
+        desiredMatched[it->second.back()] = true;
+        updates.push_back(RecordChange{RECORD_UPDATE, live[i], desired[it->second.back()]});
+        it->second.pop_back();
+    }
+    for (size_t i = 0; i < desired.size(); i++) {
+        if (!desiredMatched[i]) {
+            creates.push_back(RecordChange{RECORD_CREATE, Record{}, desired[i]});
+        }
+    }
+
+    changeSet.changes.reserve(updates.size() + creates.size() + deletes.size());
+    changeSet.changes.insert(changeSet.changes.end(), updates.begin(), updates.end());
+    changeSet.changes.insert(changeSet.changes.end(), creates.begin(), creates.end());
+    changeSet.changes.insert(changeSet.changes.end(), deletes.begin(), deletes.end());
+    return changeSet;
+}
+
+static std::string describeRecord(const Record& record)
+{
+    return record.name + " " + record.type + " '" + record.content + "' (TTL " + std::to_string(record.ttl)
+           + ", priority " + std::to_string(record.priority) + ")";
+}
+
+std::string describeChange(const RecordChange& change)
+{
+    switch (change.type) {
+        case RECORD_CREATE:
+            return "+ " + describeRecord(change.desired);
+        case RECORD_DELETE:
+            return "- " + describeRecord(change.current);
+        case RECORD_UPDATE:
+        default:
+            return "~ " + describeRecord(change.current) + " -> '" + change.desired.content + "' (TTL "
+                   + std::to_string(change.desired.ttl) + ", priority " + std::to_string(change.desired.priority) + ")";
+    }
+}
+
+// Implementation for Reconciler
+
+Reconciler::Reconciler(LopDnsClient& client, int concurrency, bool dryRun)
+    : client(client)
+{
+    this->concurrency = concurrency;
+    this->dryRun = dryRun;
+}
+
+std::vector<ReconcileResult> Reconciler::reconcile(const DesiredState& desiredState, const std::vector<std::string>& availableZones)
+{
+    std::vector<const DesiredState::value_type*> zones;
+    zones.reserve(desiredState.size());
+    for (const auto& zone : desiredState) {
+        zones.push_back(&zone);
+    }
+    return parallelMap(zones, concurrency, [this, &availableZones](const DesiredState::value_type* zone) {
+        if (std::find(availableZones.begin(), availableZones.end(), zone->first) == availableZones.end()) {
+            ReconcileResult result;
+            result.changeSet.zone = zone->first;
+            result.error = "zone not found in account";
+            return result;
+        }
+        return reconcileZone(zone->first, zone->second);
+    });
+}
+
+ReconcileResult Reconciler::reconcileZone(const std::string& zone, const std::vector<Record>& desired)
+{
+    ReconcileResult result;
+    std::vector<Record> current;
+    if (!client.getRecords(zone, current)) {
+        // Compared to an empty zone every desired record would be created again
+        result.changeSet.zone = zone;
+        result.error = "failed to fetch the records of the zone";
+        return result;
+    }
+    result.changeSet = computeChangeSet(zone, current, desired);
+    LOG_DEBUG << "Zone " << zone << ": " << result.changeSet.changes.size() << " changes, "
+              << result.changeSet.unchanged << " records unchanged.";
+
+    for (const auto& change : result.changeSet.changes) {
+        std::string description = describeChange(change);
+        if (dryRun) {
+            result.messages.push_back("[Dry run] " + description);
+            continue;
+        }
+        if (applyChange(zone, change)) {
+            result.applied++;
+            result.messages.push_back(description);
+        } else {
+            result.failed++;
+            result.messages.push_back("Failed: " + description);
+        }
+    }
+    return result;
+}
+
+bool Reconciler::applyChange(const std::string& zone, const RecordChange& change)
+{
+    switch (change.type) {
+        case RECORD_CREATE:
+        {
+            Record created = client.createRecord(zone, change.desired.name, change.desired.type, change.desired.content,
+                                                 change.desired.ttl, change.desired.priority);
+            return !created.name.empty();
+        }
+        case RECORD_UPDATE:
+        {
+            const Record& current = change.current;
+            const Record& desired = change.desired;
+            std::optional<std::string> newContent;
+            std::optional<int> newTtl;
+            std::optional<int> newPriority;
+            if (desired.content != current.content) {
+                newContent = desired.content;
+            }
+            if (desired.ttl != current.ttl) {
+                newTtl = desired.ttl;
+            }
+            if (desired.priority != current.priority) {
+                newPriority = desired.priority;
+            }
+            Record updated = client.updateRecord(zone, current.name, current.type, current.content,
+                                                 std::nullopt, std::nullopt, newContent, newTtl, newPriority);
+            return !updated.name.empty();
+        }
+        case RECORD_DELETE:
+            return client.deleteRecord(zone, change.current.name, change.current.type, change.current.content);
+    }
+    return false;
+}
@@ -0,0 +1,79 @@
+#ifndef RECONCILE_H
+#define RECONCILE_H
+
+#include <string>
+#include <list>
+#include <vector>
+#include <map>
+#include <istream>
+#include "lopdnsclient.h"
+
+typedef enum RecordChangeType {
+    RECORD_UPDATE,
+    RECORD_CREATE,
+    RECORD_DELETE
+} RecordChangeType;
+
+typedef struct RecordChange
+{
+    RecordChangeType type;
+    // The live record, not set for creates
+    Record current;
+    // The desired record, not set for deletes
+    Record desired;
+} RecordChange;
+
+// The minimal changes that turn the live records of a zone into the desired ones. Updates
+// come first, then creates and deletes, so records are only removed after their replacements exist.
+typedef struct ChangeSet
+{
+    std::string zone;
+    std::vector<RecordChange> changes;
+    size_t unchanged = 0;
+} ChangeSet;
+
+typedef struct ReconcileResult
+{
+    ChangeSet changeSet;
+    size_t applied = 0;
+    size_t failed = 0;
+    // Set if the zone could not be reconciled at all
+    std::string error;
+    std::list<std::string> messages;
+} ReconcileResult;
+
+// Desired records by zone
+typedef std::map<std::string, std::vector<Record>> DesiredState;
+
+// Reads a desired-state file, throws std::runtime_error if it is invalid, e.g.
+// {"example.com": [{"name": "www.example.com", "type": "A", "content": "1.2.3.4", "ttl": 3600}]}
+DesiredState readDesiredState(std::istream& input);
+
+// Diffs the records on (name, type, content). Records with equal keys are kept, or updated if
+// their TTL or priority differs. The remaining records are paired by name and type and updated
+// with the moved content, the rest of the desired records is created and the rest of the live
+// records deleted. Runs in O(live + desired).
+ChangeSet computeChangeSet(const std::string& zone, const std::vector<Record>& live, const std::vector<Record>& desired);
+
+std::string describeChange(const RecordChange& change);
+
+class Reconciler
+{
+public:
+    Reconciler(LopDnsClient& client, int concurrency = 4, bool dryRun = false);
+
+    // Reconciles every zone of the desired state in parallel, the results are in zone order.
+    // Zones missing from the available zones, or whose records could not be fetched, are
+    // reported as errors and left unchanged.
+    std::vector<ReconcileResult> reconcile(const DesiredState& desiredState, const std::vector<std::string>& availableZones);
+
+private:
+    ReconcileResult reconcileZone(const std::string& zone, const std::vector<Record>& desired);
+    bool applyChange(const std::string& zone, const RecordChange& change);
+
+    LopDnsClient& client;
+    int concurrency;
+    bool dryRun;
+};
+
+#endif // RECONCILE_H
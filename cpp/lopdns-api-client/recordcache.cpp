@@ -0,0 +1,145 @@
+#include "logging.h"
+
+#include "recordcache.h"
+#include "lopdnsclient.h"
+
+RecordCache::RecordCache(int freshnessInSeconds)
+{
+    this->freshness = freshnessInSeconds;
+}
+
+std::shared_ptr<const CachedZone> RecordCache::lookup(const std::string& zone, bool& fresh)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    fresh = false;
+    auto it = zones.find(zone);
+    if (it == zones.end()) {
+        return nullptr;
+    }
+    if (!hasValidators(*it->second.zone)) {
+        auto age = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - it->second.fetchedAt).count();
+        fresh = age < freshness;
+    }
+    return it->second.zone;
+}
+
+// Called with the mutex held. Readers only get a zone through lookup, so if the entry holds
+// the only reference nobody else sees it change.
+CachedZone& RecordCache::writableZone(Entry& entry)
+{
+    if (entry.zone.use_count() != 1) {
+        entry.zone = std::make_shared<CachedZone>(*entry.zone);
+    }
+    // Every cached zone is created non-const, by store or by the copy above
+    CachedZone& zone = const_cast<CachedZone&>(*entry.zone);
+    if (hasValidators(zone)) {
+        zone.etag.clear();
+        zone.lastModified.clear();
+        entry.fetchedAt = std::chrono::steady_clock::now();
+    }
+    return zone;
+}
+
+void RecordCache::store(const std::string& zone, const std::vector<Record>& records,
+                        const std::string& etag, const std::string& lastModified)
+{
+    auto cached = std::make_shared<CachedZone>();
+    cached->records = records;
+    cached->etag = etag;
+    cached->lastModified = lastModified;
+    std::lock_guard<std::mutex> lock(mutex);
+    zones[zone] = Entry{std::move(cached), std::chrono::steady_clock::now()};
+}
+
+void RecordCache::markRevalidated(const std::string& zone)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = zones.find(zone);
+    if (it != zones.end()) {
+        it->second.fetchedAt = std::chrono::steady_clock::now();
+    }
+    stats.revalidated++;
+}
+
+void RecordCache::countHit()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.hits++;
+}
+
+void RecordCache::countMiss()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.misses++;
+}
+
+void RecordCache::recordCreated(const std::string& zone, const Record& record)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = zones.find(zone);
+    if (it == zones.end()) {
+        return;
+    }
+    writableZone(it->second).records.push_back(record);
+    stats.writes++;
+    LOG_DEBUG << "Added record " << record.name << " to cached zone " << zone;
+}
+
+void RecordCache::recordUpdated(const std::string& zone, const std::string& oldName, const std::string& oldType,
+                                const std::string& oldContent, const Record& record)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = zones.find(zone);
+    if (it == zones.end()) {
+        return;
+    }
+    const auto& records = it->second.zone->records;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (records[i].name == oldName && records[i].type == oldType && records[i].content == oldContent) {
+            writableZone(it->second).records[i] = record;
+            stats.writes++;
+            LOG_DEBUG << "Updated record " << record.name << " in cached zone " << zone;
+            return;
+        }
+    }
+    // The cached copy does not know the record, it has to be fetched again
+    zones.erase(it);
+}
+
+void RecordCache::recordDeleted(const std::string& zone, const std::string& name, const std::string& type,
+                                const std::string& content)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = zones.find(zone);
+    if (it == zones.end()) {
+        return;
+    }
+    const auto& records = it->second.zone->records;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (records[i].name == name && records[i].type == type && records[i].content == content) {
+            auto& written = writableZone(it->second).records;
+            written.erase(written.begin() + i);
+            stats.writes++;
+            LOG_DEBUG << "Removed record " << name << " from cached zone " << zone;
+            return;
+        }
+    }
+}
+
+void RecordCache::invalidate(const std::string& zone)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    zones.erase(zone);
+}
+
+void RecordCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    zones.clear();
+}
+
+RecordCacheStats RecordCache::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,84 @@
+#ifndef RECORDCACHE_H
+#define RECORDCACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <memory>
+
+struct Record;
+
+typedef struct CachedZone
+{
+    std::vector<Record> records;
+    // Validators sent by the server, empty if it did not send any
+    std::string etag;
+    std::string lastModified;
+} CachedZone;
+
+typedef struct RecordCacheStats
+{
+    // Served from the cache without a request
+    long long hits = 0;
+    // Confirmed with a conditional request answered by 304 Not Modified
+    long long revalidated = 0;
+    long long misses = 0;
+    // Local writes applied to a cached zone
+    long long writes = 0;
+} RecordCacheStats;
+
+// Per-zone record lists kept by LopDnsClient. A zone with validators is revalidated with a
+// conditional request on every read, a zone without them is served from the cache while it
+// is younger than the freshness window. Writes made through the client are applied to the
+// cached records directly, so they do not force a refetch. The validators of a written zone
+// no longer match the server, so they are dropped and the zone is served for the freshness
+// window from the write on.
+//
+// Readers share a cached zone without copying it. A zone is never changed while it is handed
+// out, a write replaces it with a changed copy unless no reader holds it.
+class RecordCache
+{
+public:
+    explicit RecordCache(int freshnessInSeconds = 30);
+
+    // The cached zone, empty if the zone is not cached. fresh is set if the zone has no
+    // validators and is still inside the freshness window.
+    std::shared_ptr<const CachedZone> lookup(const std::string& zone, bool& fresh);
+    bool hasValidators(const CachedZone& cached) const { return !cached.etag.empty() || !cached.lastModified.empty(); }
+
+    void store(const std::string& zone, const std::vector<Record>& records,
+               const std::string& etag, const std::string& lastModified);
+    // Marks a zone as just fetched after the server answered 304 Not Modified
+    void markRevalidated(const std::string& zone);
+    void countHit();
+    void countMiss();
+
+    void recordCreated(const std::string& zone, const Record& record);
+    void recordUpdated(const std::string& zone, const std::string& oldName, const std::string& oldType,
+                       const std::string& oldContent, const Record& record);
+    void recordDeleted(const std::string& zone, const std::string& name, const std::string& type,
+                       const std::string& content);
+    void invalidate(const std::string& zone);
+    void clear();
+
+    RecordCacheStats getStats();
+
+private:
+    typedef struct Entry
+    {
+        std::shared_ptr<const CachedZone> zone;
+        std::chrono::steady_clock::time_point fetchedAt;
+    } Entry;
+
+    // The zone of the entry to apply a local write to
+    CachedZone& writableZone(Entry& entry);
+
+    int freshness;
+    std::map<std::string, Entry> zones;
+    RecordCacheStats stats;
+    std::mutex mutex;
+};
+
+#endif // RECORDCACHE_H
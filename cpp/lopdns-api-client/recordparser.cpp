@@ -0,0 +1,280 @@
+#include "nlohmann/json.hpp"
+
+#include "recordparser.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cctype>
+
+using json = nlohmann::json;
+
+typedef enum ResponseShape {
+    SHAPE_RECORD_LIST,
+    SHAPE_ZONE_LIST,
+    SHAPE_RECORD
+} ResponseShape;
+
+// Collects records or zone names while the parser walks the body. Values nested deeper
+// than the fields of a record are skipped.
+class ResponseSaxHandler : public nlohmann::json_sax<json>
+{
+public:
+    ResponseSaxHandler(ResponseShape shape, std::vector<Record>* records, std::vector<std::string>* zones)
+        : shape(shape), records(records), zones(zones)
+    {
+        objectDepth = shape == SHAPE_RECORD ? 1 : 2;
+    }
+
+    const std::string& error() const { return errorMessage; }
+
+    bool null() override { return scalar(); }
+    bool boolean(bool) override { return scalar(); }
+    bool number_integer(number_integer_t value) override { return number(value); }
+    bool number_unsigned(number_unsigned_t value) override { return number(static_cast<long long>(value)); }
+    bool number_float(number_float_t value, const string_t&) override { return number(static_cast<long long>(value)); }
+    bool binary(binary_t&) override { return scalar(); }
+
+    bool string(string_t& value) override
+    {
+        if (!scalar()) {
+            return false;
+        }
+        if (shape == SHAPE_ZONE_LIST && depth == 1) {
+            zones->push_back(std::move(value));
+        }
+        else if (inObject && depth == objectDepth) {
+            if (currentKey == "name") {
+                if (shape == SHAPE_ZONE_LIST) {
+                    zones->push_back(std::move(value));
+                } else {
+                    current.name = std::move(value);
+                }
+            } else if (currentKey == "type") {
+                current.type = std::move(value);
+            } else if (currentKey == "content" || currentKey == "value" || currentKey == "data") {
+                current.content = std::move(value);
+            } else if (currentKey == "ttl" || currentKey == "prio" || currentKey == "priority") {
+                // Numbers sent as strings are accepted as well
+                try
+                {
+                    return number(std::stoll(value));
+                }
+                catch (const std::exception&)
+                {
+                    return fail("invalid number in '" + currentKey + "': " + value);
+                }
+            }
+        }
+        return true;
+    }
+
+    bool start_object(std::size_t) override
+    {
+        if (depth == 0 && shape != SHAPE_RECORD) {
+            return fail("expected top-level array");
+        }
+        depth++;
+        if (depth == objectDepth) {
+            inObject = true;
+            current = Record{"", "", "", 0, 0};
+        }
+        return true;
+    }
+
+    bool end_object() override
+    {
+        if (inObject && depth == objectDepth) {
+            inObject = false;
+            if (shape != SHAPE_ZONE_LIST) {
+                records->push_back(std::move(current));
+            }
+        }
+        depth--;
+        return true;
+    }
+
+    bool start_array(std::size_t) override
+    {
+        if (depth == 0 && shape == SHAPE_RECORD) {
+            return fail("expected top-level object");
+        }
+        depth++;
+        return true;
+    }
+
+    bool end_array() override
+    {
+        depth--;
+        return true;
+    }
+
+    bool key(string_t& value) override
+    {
+        if (depth == objectDepth) {
+            currentKey = std::move(value);
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override
+    {
+        return fail(ex.what());
+    }
+
+private:
+    bool scalar()
+    {
+        if (depth == 0) {
+            return fail(shape == SHAPE_RECORD ? "expected top-level object" : "expected top-level array");
+        }
+        return true;
+    }
+
+    bool number(long long value)
+    {
+        if (!scalar()) {
+            return false;
+        }
+        if (inObject && depth == objectDepth) {
+            if (currentKey == "ttl") {
+                current.ttl = static_cast<int>(value);
+            } else if (currentKey == "prio" || currentKey == "priority") {
+                current.priority = static_cast<int>(value);
+            }
+        }
+        return true;
+    }
+
+    bool fail(const std::string& message)
+    {
+        if (errorMessage.empty()) {
+            errorMessage = message;
+        }
+        return false;
+    }
+
+    ResponseShape shape;
+    std::vector<Record>* records;
+    std::vector<std::string>* zones;
+    int depth = 0;
+    int objectDepth;
+    bool inObject = false;
+    std::string currentKey;
+    Record current{"", "", "", 0, 0};
+    std::string errorMessage;
+};
+
+// Every record and zone object starts with a '{', which gives a cheap upper bound
+// for the number of elements without parsing the body
+static size_t estimateElementCount(std::string_view body)
+{
+    return static_cast<size_t>(std::count(body.begin(), body.end(), '{'));
+}
+
+static void parse(std::string_view body, ResponseSaxHandler& handler)
+{
+    if (!json::sax_parse(body.begin(), body.end(), &handler)) {
+        throw std::runtime_error(handler.error().empty() ? "invalid JSON response" : handler.error());
+    }
+}
+
+std::vector<Record> parseRecordList(std::string_view body)
+{
+    std::vector<Record> records;
+    records.reserve(estimateElementCount(body));
+    ResponseSaxHandler handler(SHAPE_RECORD_LIST, &records, nullptr);
+    parse(body, handler);
+    return records;
+}
+
+std::vector<std::string> parseZoneList(std::string_view body)
+{
+    std::vector<std::string> zones;
+    // Zone names are returned as bare strings, so the separators give the upper bound
+    zones.reserve(static_cast<size_t>(std::count(body.begin(), body.end(), ',')) + 1);
+    ResponseSaxHandler handler(SHAPE_ZONE_LIST, nullptr, &zones);
+    parse(body, handler);
+    return zones;
+}
+
+Record parseRecord(std::string_view body)
+{
+    std::vector<Record> records;
+    ResponseSaxHandler handler(SHAPE_RECORD, &records, nullptr);
+    parse(body, handler);
+    if (records.empty()) {
+        throw std::runtime_error("expected a record object");
+    }
+    return std::move(records.front());
+}
+
+// Implementation for RecordStreamParser
+
+RecordStreamParser::RecordStreamParser(const std::function<bool(const Record&)>& callback)
+{
+    this->callback = callback;
+}
+
+bool RecordStreamParser::feed(std::string_view data)
+{
+    size_t i = 0;
+    while (i < data.size() && !stopped) {
+        char c = data[i];
+        if (state != STREAM_IN_OBJECT) {
+            i++;
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                continue;
+            }
+            if (state == STREAM_BEFORE_ARRAY) {
+                if (c != '[') {
+                    throw std::runtime_error("expected top-level array");
+                }
+                state = STREAM_IN_ARRAY;
+            } else if (state == STREAM_IN_ARRAY && c == '{') {
+                object.assign(1, c);
+                depth = 1;
+                state = STREAM_IN_OBJECT;
+            } else if (state == STREAM_IN_ARRAY && c == ']') {
+                state = STREAM_DONE;
+            } else if (state != STREAM_IN_ARRAY || c != ',') {
+                throw std::runtime_error(std::string("unexpected '") + c + "' in record list");
+            }
+            continue;
+        }
+
+        // Find the end of the object in this piece, its text is then decoded in one go
+        size_t start = i;
+        for (; i < data.size() && depth > 0; i++) {
+            c = data[i];
+            if (inString) {
+                if (escaped) {
+                    escaped = false;
+                } else if (c == '\\') {
+                    escaped = true;
+                } else if (c == '"') {
+                    inString = false;
+                }
+            } else if (c == '"') {
+                inString = true;
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                depth--;
+            }
+        }
+        object.append(data.substr(start, i - start));
+        if (depth == 0) {
+            state = STREAM_IN_ARRAY;
+            records++;
+            stopped = !callback(parseRecord(object));
+            object.clear();
+        }
+    }
+    return !stopped;
+}
+
+void RecordStreamParser::finish() const
+{
+    if (state != STREAM_DONE) {
+        throw std::runtime_error("incomplete record list");
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef RECORDPARSER_H
+#define RECORDPARSER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include "lopdnsclient.h"
+
+// Decoders for the API responses that fill the client structs directly through the
+// nlohmann SAX interface, without building a json DOM first. They throw std::runtime_error
+// if the body is not valid JSON or does not have the expected shape. The body is read in
+// place, e.g. from Response::view().
+//
+// Record fields are accepted under all names used by the API: the content as 'content',
+// 'value' or 'data' and the priority as 'prio' or 'priority'.
+
+// A JSON array of records, as returned by GET /records/{zone}
+std::vector<Record> parseRecordList(std::string_view body);
+
+// A JSON array of zone names, as returned by GET /zones. Zone objects with a 'name'
+// member, as described in the API documentation, are accepted as well.
+std::vector<std::string> parseZoneList(std::string_view body);
+
+// A single JSON record object, as returned by POST and PUT /records/{zone}
+Record parseRecord(std::string_view body);
+
+// Decodes a JSON array of records that arrives in pieces. Every record is passed to the
+// callback as soon as its object is complete, only the unfinished object is buffered, so the
+// memory used does not grow with the number of records. The callback returns false to stop.
+class RecordStreamParser
+{
+public:
+    explicit RecordStreamParser(const std::function<bool(const Record&)>& callback);
+
+    // Returns false once the callback asked to stop, throws std::runtime_error on invalid input
+    bool feed(std::string_view data);
+    // Throws std::runtime_error if the array is not complete
+    void finish() const;
+    // Records passed to the callback
+    size_t count() const { return records; }
+
+private:
+    typedef enum StreamState {
+        STREAM_BEFORE_ARRAY,
+        STREAM_IN_ARRAY,
+        STREAM_IN_OBJECT,
+        STREAM_DONE
+    } StreamState;
+
+    std::function<bool(const Record&)> callback;
+    StreamState state = STREAM_BEFORE_ARRAY;
+    // The record object read so far
+    std::string object;
+    int depth = 0;
+    bool inString = false;
+    bool escaped = false;
+    bool stopped = false;
+    size_t records = 0;
+};
+
+#endif // RECORDPARSER_H
@@ -0,0 +1,138 @@
+#include "logging.h"
+
+#include "recordselector.h"
+#include <cctype>
+#include <cstring>
+
+// ECMAScript metacharacters, anything else in a pattern matches itself
+static const char* REGEX_METACHARACTERS = "^$\\.*+?()[]{}|";
+
+static bool endsWith(const std::string& value, const std::string& suffix)
+{
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool ContentMatcher::parseLiteral(const std::string& pattern, std::string& literal)
+{
+    literal.clear();
+    literal.reserve(pattern.size());
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '\\') {
+            // An escaped punctuation character is literal, \d, \b, \1 and friends are not
+            if (i + 1 >= pattern.size() || std::isalnum(static_cast<unsigned char>(pattern[i + 1]))) {
+                return false;
+            }
+            literal += pattern[++i];
+        }
+        else if (std::strchr(REGEX_METACHARACTERS, c) != nullptr) {
+            return false;
+        }
+        else {
+            literal += c;
+        }
+    }
+    return true;
+}
+
+ContentMatcher::ContentMatcher(const std::string& pattern)
+{
+    if (pattern.empty()) {
+        mode = MATCH_ANY;
+        return;
+    }
+
+    // Strip unescaped anchors, the rest must be a literal for the fast path
+    std::string body = pattern;
+    bool anchoredStart = false;
+    bool anchoredEnd = false;
+    if (body.front() == '^') {
+        anchoredStart = true;
+        body.erase(0, 1);
+    }
+    if (!body.empty() && body.back() == '$' && !endsWith(body, "\\$")) {
+        anchoredEnd = true;
+        body.pop_back();
+    }
+
+    if (parseLiteral(body, literal)) {
+        if (anchoredStart && anchoredEnd) {
+            mode = MATCH_EXACT;
+        } else if (anchoredStart) {
+            mode = MATCH_PREFIX;
+        } else if (anchoredEnd) {
+            mode = MATCH_SUFFIX;
+        } else {
+            mode = MATCH_SUBSTRING;
+        }
+        LOG_DEBUG << "Content pattern '" << pattern << "' is matched as a literal.";
+        return;
+    }
+
+    mode = MATCH_REGEX;
+    literal.clear();
+    regex = std::make_shared<const std::regex>(pattern);
+    LOG_DEBUG << "Content pattern '" << pattern << "' is matched as a regular expression.";
+}
+
+bool ContentMatcher::matches(const std::string& content) const
+{
+    switch (mode) {
+        case MATCH_ANY:
+            return true;
+        case MATCH_SUBSTRING:
+            return content.find(literal) != std::string::npos;
+        case MATCH_PREFIX:
+            return content.compare(0, literal.size(), literal) == 0;
+        case MATCH_SUFFIX:
+            return endsWith(content, literal);
+        case MATCH_EXACT:
+            return content == literal;
+        case MATCH_REGEX:
+        default:
+            return std::regex_search(content, *regex);
+    }
+}
+
+ContentReplacer::ContentReplacer(const std::string& pattern, const std::string& replacement)
+{
+    this->replacement = replacement;
+    // '$' in the replacement refers to the match, and an empty pattern matches between every character,
+    // both are left to the regex engine
+    if (!pattern.empty() && replacement.find('$') == std::string::npos && ContentMatcher::parseLiteral(pattern, literal)) {
+        LOG_DEBUG << "Replace pattern '" << pattern << "' is replaced as a literal.";
+        return;
+    }
+    literal.clear();
+    regex = std::make_shared<const std::regex>(pattern);
+    LOG_DEBUG << "Replace pattern '" << pattern << "' is replaced as a regular expression.";
+}
+
+std::string ContentReplacer::replace(const std::string& content) const
+{
+    if (regex) {
+        return std::regex_replace(content, *regex, replacement);
+    }
+
+    std::string result;
+    result.reserve(content.size());
+    size_t position = 0;
+    size_t found;
+    while ((found = content.find(literal, position)) != std::string::npos) {
+        result.append(content, position, found - position);
+        result += replacement;
+        position = found + literal.size();
+    }
+    result.append(content, position, std::string::npos);
+    return result;
+}
+
+RecordSelector::RecordSelector(const std::string& name, const std::string& type, const std::string& contentPattern)
+    : recordName(name), recordType(type), content(contentPattern)
+{
+}
+
+bool RecordSelector::matches(const Record& record) const
+{
+    return record.name == recordName && record.type == recordType && content.matches(record.content);
+}
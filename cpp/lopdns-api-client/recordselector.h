@@ -0,0 +1,70 @@
+#ifndef RECORDSELECTOR_H
+#define RECORDSELECTOR_H
+
+#include <string>
+#include <regex>
+#include <memory>
+#include "lopdnsclient.h"
+
+// A content pattern with std::regex_search semantics that is compiled once. Patterns without
+// regex metacharacters are matched with a substring search, and anchored literals (^abc, abc$, ^abc$)
+// with a prefix, suffix or exact compare. The regex engine only runs for real regular expressions.
+class ContentMatcher
+{
+public:
+    explicit ContentMatcher(const std::string& pattern = "");
+
+    bool matches(const std::string& content) const;
+    bool isLiteral() const { return mode != MATCH_REGEX; }
+
+    // Returns true and the unescaped text if the pattern matches only itself
+    static bool parseLiteral(const std::string& pattern, std::string& literal);
+
+private:
+    typedef enum MatchMode {
+        MATCH_ANY,
+        MATCH_SUBSTRING,
+        MATCH_PREFIX,
+        MATCH_SUFFIX,
+        MATCH_EXACT,
+        MATCH_REGEX
+    } MatchMode;
+
+    MatchMode mode;
+    std::string literal;
+    std::shared_ptr<const std::regex> regex;
+};
+
+// A compiled std::regex_replace, with a plain string replacement for literal patterns
+class ContentReplacer
+{
+public:
+    ContentReplacer(const std::string& pattern, const std::string& replacement);
+
+    std::string replace(const std::string& content) const;
+    bool isLiteral() const { return !regex; }
+
+private:
+    std::string literal;
+    std::string replacement;
+    std::shared_ptr<const std::regex> regex;
+};
+
+// Selects records by exact name and type and a content pattern
+class RecordSelector
+{
+public:
+    RecordSelector(const std::string& name, const std::string& type, const std::string& contentPattern = "");
+
+    bool matches(const Record& record) const;
+
+    const std::string& name() const { return recordName; }
+    const std::string& type() const { return recordType; }
+
+private:
+    std::string recordName;
+    std::string recordType;
+    ContentMatcher content;
+};
+
+#endif // RECORDSELECTOR_H
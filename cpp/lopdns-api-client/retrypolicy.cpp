@@ -0,0 +1,74 @@
+#include "retrypolicy.h"
+#include <ctime>
+#include <cctype>
+#include <algorithm>
+
+RetryPolicy::RetryPolicy(const RetrySettings& settings)
+    : random(std::random_device{}())
+{
+    this->settings = settings;
+}
+
+bool RetryPolicy::shouldRetry(const std::string& method, int code, int attempt) const
+{
+    if (attempt >= settings.maxAttempts) {
+        return false;
+    }
+    bool connectionError = code < 0;
+    if (method == "GET") {
+        return connectionError || code == 429 || code >= 500;
+    }
+    if (method == "PUT" || method == "DELETE") {
+        return connectionError;
+    }
+    return false;
+}
+
+long RetryPolicy::parseRetryAfter(const std::string& retryAfter)
+{
+    if (retryAfter.empty()) {
+        return -1;
+    }
+    if (std::all_of(retryAfter.begin(), retryAfter.end(), [](unsigned char c) { return std::isdigit(c); })) {
+        try
+        {
+            return std::stol(retryAfter);
+        }
+        catch (const std::exception&)
+        {
+            return -1;
+        }
+    }
+
+    // HTTP date, e.g. "Wed, 21 Oct 2015 07:28:00 GMT"
+    std::tm date = {};
+    if (strptime(retryAfter.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &date) == nullptr) {
+        return -1;
+    }
+    long seconds = static_cast<long>(timegm(&date) - std::time(nullptr));
+    return std::max(seconds, 0L);
+}
+
+std::chrono::milliseconds RetryPolicy::delayFor(int attempt, const std::string& retryAfter)
+{
+    long long ceiling = settings.baseDelayInMilliseconds;
+    for (int i = 1; i < attempt && ceiling < settings.maxDelayInMilliseconds; i++) {
+        ceiling *= 2;
+    }
+    ceiling = std::min<long long>(ceiling, settings.maxDelayInMilliseconds);
+
+    long long delay = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        delay = std::uniform_int_distribution<long long>(0, std::max(ceiling, 0LL))(random);
+    }
+
+    long retryAfterSeconds = parseRetryAfter(retryAfter);
+    if (retryAfterSeconds > settings.maxRetryAfterInSeconds) {
+        return std::chrono::milliseconds(-1);
+    }
+    if (retryAfterSeconds >= 0) {
+        delay = std::max(delay, retryAfterSeconds * 1000LL);
+    }
+    return std::chrono::milliseconds(delay);
+}
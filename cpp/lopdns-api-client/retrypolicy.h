@@ -0,0 +1,46 @@
+#ifndef RETRYPOLICY_H
+#define RETRYPOLICY_H
+
+#include <string>
+#include <mutex>
+#include <random>
+#include <chrono>
+
+typedef struct RetrySettings
+{
+    // Attempts per request including the first one, 1 disables retries
+    int maxAttempts = 3;
+    int baseDelayInMilliseconds = 200;
+    int maxDelayInMilliseconds = 5000;
+    // A Retry-After longer than this is not waited for, the response is returned instead
+    int maxRetryAfterInSeconds = 60;
+} RetrySettings;
+
+// Decides which failed requests are sent again and how long to wait before. GET is retried on
+// connection errors, 5xx and 429. PUT and DELETE only on connection errors, they match the record
+// by its old content so a repeated request cannot change another record. POST is never retried
+// since a repeated create would add the record twice.
+class RetryPolicy
+{
+public:
+    explicit RetryPolicy(const RetrySettings& settings = RetrySettings());
+
+    // code is the HTTP status, or -1 if no response was received
+    bool shouldRetry(const std::string& method, int code, int attempt) const;
+    // Full jitter: a random delay between 0 and min(maxDelay, baseDelay * 2^(attempt - 1)). A
+    // Retry-After header (seconds or HTTP date) is used instead if it is longer. Returns a
+    // negative delay if the Retry-After is beyond maxRetryAfterInSeconds.
+    std::chrono::milliseconds delayFor(int attempt, const std::string& retryAfter);
+
+    const RetrySettings& getSettings() const { return settings; }
+
+    // Seconds to wait according to a Retry-After value, -1 if it cannot be parsed
+    static long parseRetryAfter(const std::string& retryAfter);
+
+private:
+    RetrySettings settings;
+    std::mt19937 random;
+    std::mutex mutex;
+};
+
+#endif // RETRYPOLICY_H
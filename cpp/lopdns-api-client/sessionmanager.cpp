@@ -0,0 +1,190 @@
+#include "nlohmann/json.hpp"
+#include "logging.h"
+
+#include "sessionmanager.h"
+#include <set>
+#include <algorithm>
+
+using json = nlohmann::json;
+
+std::vector<AccountCredentials> readCredentials(std::istream& input)
+{
+    json data;
+    try
+    {
+        data = json::parse(input);
+    }
+    catch (const json::exception& e)
+    {
+        throw std::runtime_error(std::string("invalid credentials file: ") + e.what());
+    }
+    auto accountsIt = data.find("accounts");
+    if (!data.is_object() || accountsIt == data.end() || !accountsIt->is_array()) {
+        throw std::runtime_error("invalid credentials file: expected an object with an 'accounts' array");
+    }
+
+    std::vector<AccountCredentials> accounts;
+    std::set<std::string> names;
+    for (const auto& item : *accountsIt) {
+        std::string position = "accounts[" + std::to_string(accounts.size()) + "]";
+        AccountCredentials account;
+        try
+        {
+            account.clientId = item.at("clientId").get<std::string>();
+            account.name = item.value("name", position);
+        }
+        catch (const json::exception& e)
+        {
+            throw std::runtime_error("invalid credentials file: " + position + ": " + e.what());
+        }
+        if (account.clientId.empty()) {
+            throw std::runtime_error("invalid credentials file: " + position + ": clientId is empty");
+        }
+        if (!names.insert(account.name).second) {
+            throw std::runtime_error("invalid credentials file: duplicate account name '" + account.name + "'");
+        }
+        accounts.push_back(account);
+    }
+    if (accounts.empty()) {
+        throw std::runtime_error("invalid credentials file: no accounts");
+    }
+    return accounts;
+}
+
+// Implementation for SessionManager
+
+SessionManager::SessionManager(const std::vector<AccountCredentials>& accounts, const SessionSettings& settings)
+{
+    this->tokenDuration = settings.tokenDurationInSeconds;
+    this->concurrency = std::max(settings.concurrency, 1);
+    if (settings.tokenStoreDirectory.has_value()) {
+        tokenStore.emplace(settings.tokenStoreDirectory.value());
+    }
+
+    sessions.reserve(accounts.size());
+    for (const auto& account : accounts) {
+        auto session = std::make_unique<Session>();
+        session->credentials = account;
+        session->client = std::make_unique<LopDnsClient>(settings.baseUrl, settings.timeoutInSeconds, settings.poolSettings);
+        session->client->setRetrySettings(settings.retrySettings);
+        session->client->setTokenRefreshMargin(settings.tokenRefreshMarginInSeconds);
+        if (settings.recordCacheInSeconds > 0) {
+            session->client->enableRecordCache(settings.recordCacheInSeconds);
+        }
+        if (tokenStore.has_value()) {
+            TokenStore* store = &tokenStore.value();
+            std::string clientId = account.clientId;
+            session->client->setTokenListener([store, clientId](const Token& token) {
+                store->save(clientId, token);
+            });
+        }
+        sessions.push_back(std::move(session));
+    }
+}
+
+bool SessionManager::authenticateSession(Session& session, int refreshMarginInSeconds)
+{
+    const std::string& clientId = session.credentials.clientId;
+    Token storedToken;
+    if (tokenStore.has_value() && session.client->getToken().token.empty() && tokenStore->load(clientId, storedToken)) {
+        session.client->restoreToken(clientId, tokenDuration, storedToken);
+    }
+    if (!session.client->getToken().token.empty() && !session.client->isTokenExpired(refreshMarginInSeconds)) {
+        return true;
+    }
+    LOG_DEBUG << "Authenticating account " << session.credentials.name << ".";
+    return session.client->authenticate(clientId, tokenDuration);
+}
+
+std::vector<std::string> SessionManager::refreshTokens(int refreshMarginInSeconds)
+{
+    auto succeeded = parallelMap(sessions, concurrency, [this, refreshMarginInSeconds](const std::unique_ptr<Session>& session) {
+        return authenticateSession(*session, refreshMarginInSeconds);
+    });
+    std::vector<std::string> failed;
+    for (size_t i = 0; i < sessions.size(); i++) {
+        if (!succeeded[i]) {
+            LOG_ERROR << "Authentication of account " << sessions[i]->credentials.name << " failed.";
+            failed.push_back(sessions[i]->credentials.name);
+        }
+    }
+    return failed;
+}
+
+void SessionManager::invalidateTokens()
+{
+    parallelMap(sessions, concurrency, [this](const std::unique_ptr<Session>& session) {
+        bool invalidated = session->client->getToken().token.empty() || session->client->invalidateToken();
+        if (tokenStore.has_value()) {
+            tokenStore->remove(session->credentials.clientId);
+        }
+        return invalidated;
+    });
+}
+
+std::vector<std::string> SessionManager::discoverZones()
+{
+    auto accountZones = parallelMap(sessions, concurrency, [](const std::unique_ptr<Session>& session) {
+        return session->client->getZones();
+    });
+
+    zoneOwners.clear();
+    for (size_t i = 0; i < sessions.size(); i++) {
+        for (const auto& zone : accountZones[i]) {
+            auto inserted = zoneOwners.emplace(zone, sessions[i].get());
+            if (!inserted.second) {
+                LOG_WARNING << "Zone " << zone << " is listed by accounts " << inserted.first->second->credentials.name
+                            << " and " << sessions[i]->credentials.name << ", using " << inserted.first->second->credentials.name << ".";
+            }
+        }
+    }
+
+    std::vector<std::string> zones;
+    zones.reserve(zoneOwners.size());
+    for (const auto& owner : zoneOwners) {
+        zones.push_back(owner.first);
+    }
+    return zones;
+}
+
+LopDnsClient* SessionManager::clientForZone(const std::string& zone)
+{
+    auto it = zoneOwners.find(zone);
+    return it == zoneOwners.end() ? nullptr : it->second->client.get();
+}
+
+std::string SessionManager::accountForZone(const std::string& zone) const
+{
+    auto it = zoneOwners.find(zone);
+    return it == zoneOwners.end() ? "" : it->second->credentials.name;
+}
+
+std::map<std::string, std::vector<std::string>> SessionManager::zonesByAccount() const
+{
+    std::map<std::string, std::vector<std::string>> zones;
+    for (const auto& owner : zoneOwners) {
+        zones[owner.second->credentials.name].push_back(owner.first);
+    }
+    return zones;
+}
+
+void SessionManager::collectMetrics(MetricsRegistry& registry)
+{
+    for (const auto& session : sessions) {
+        registry.merge(session->client->getMetrics(), {{"account", session->credentials.name}});
+    }
+}
+
+ConnectionPoolStats SessionManager::getConnectionPoolStats()
+{
+    ConnectionPoolStats total;
+    for (const auto& session : sessions) {
+        ConnectionPoolStats stats = session->client->getConnectionPoolStats();
+        total.created += stats.created;
+        total.reused += stats.reused;
+        total.evicted += stats.evicted;
+        total.open += stats.open;
+        total.idle += stats.idle;
+    }
+    return total;
+}
@@ -0,0 +1,95 @@
+#ifndef SESSIONMANAGER_H
+#define SESSIONMANAGER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <optional>
+#include <istream>
+#include <utility>
+#include "lopdnsclient.h"
+#include "tokenstore.h"
+#include "workerpool.h"
+
+typedef struct AccountCredentials
+{
+    // Used in logs and metric labels instead of the client id
+    std::string name;
+    std::string clientId;
+} AccountCredentials;
+
+// Reads a credentials file, throws std::runtime_error if it is invalid, e.g.
+// {"accounts": [{"name": "customers", "clientId": "<client-id>"}]}
+std::vector<AccountCredentials> readCredentials(std::istream& input);
+
+typedef struct SessionSettings
+{
+    std::string baseUrl;
+    int timeoutInSeconds = 10;
+    ConnectionPoolSettings poolSettings;
+    RetrySettings retrySettings;
+    int tokenDurationInSeconds = 3600;
+    int tokenRefreshMarginInSeconds = 60;
+    int recordCacheInSeconds = 0;
+    // Accounts are authenticated, refreshed and queried with up to this many in parallel
+    int concurrency = 4;
+    // Tokens are kept between runs if set
+    std::optional<std::string> tokenStoreDirectory;
+} SessionSettings;
+
+// One authenticated client per account. Every account has its own token, connection pool
+// and metrics, zones are routed to the account that lists them in getZones.
+class SessionManager
+{
+public:
+    SessionManager(const std::vector<AccountCredentials>& accounts, const SessionSettings& settings);
+
+    // Authenticates in parallel every account that has no token or whose token expires within
+    // the margin, stored tokens are reused. Returns the names of the accounts that failed.
+    std::vector<std::string> refreshTokens(int refreshMarginInSeconds);
+    // Invalidates the tokens of all accounts, stored tokens are removed
+    void invalidateTokens();
+
+    // Fetches the zone list of every account and routes each zone to its account. A zone listed
+    // by several accounts is routed to the first of them. Returns all zones in name order.
+    std::vector<std::string> discoverZones();
+    // The client of the account owning the zone, nullptr if no account lists it
+    LopDnsClient* clientForZone(const std::string& zone);
+    std::string accountForZone(const std::string& zone) const;
+    // Zones of discoverZones grouped by account name
+    std::map<std::string, std::vector<std::string>> zonesByAccount() const;
+
+    // Calls fn(name, client) for every account in parallel, the results are in account order
+    template <typename Fn>
+    auto forEachAccount(Fn fn)
+        -> std::vector<typename std::decay<decltype(fn(std::string(), std::declval<LopDnsClient&>()))>::type>
+    {
+        return parallelMap(sessions, concurrency, [&fn](const std::unique_ptr<Session>& session) {
+            return fn(session->credentials.name, *session->client);
+        });
+    }
+
+    size_t size() const { return sessions.size(); }
+
+    // Metrics of all accounts with an additional "account" label
+    void collectMetrics(MetricsRegistry& registry);
+    ConnectionPoolStats getConnectionPoolStats();
+
+private:
+    typedef struct Session
+    {
+        AccountCredentials credentials;
+        std::unique_ptr<LopDnsClient> client;
+    } Session;
+
+    bool authenticateSession(Session& session, int refreshMarginInSeconds);
+
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::map<std::string, Session*> zoneOwners;
+    std::optional<TokenStore> tokenStore;
+    int tokenDuration;
+    int concurrency;
+};
+
+#endif // SESSIONMANAGER_H
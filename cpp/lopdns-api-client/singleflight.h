@@ -0,0 +1,102 @@
+#ifndef SINGLEFLIGHT_H
+#define SINGLEFLIGHT_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <exception>
+
+// Coalesces identical concurrent calls: while a call for a key is running, later calls for the
+// same key wait for it and share its result instead of running again. Exceptions are passed on
+// to all waiting callers. The result is not copied, callers that need their own copy use take().
+template <typename Result>
+class SingleFlight
+{
+public:
+    template <typename Fn>
+    std::shared_ptr<const Result> run(const std::string& key, Fn fn, bool& shared)
+    {
+        std::promise<std::shared_ptr<const Result>> promise;
+        std::shared_future<std::shared_ptr<const Result>> future;
+        unsigned long long id = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = calls.find(key);
+            shared = it != calls.end();
+            if (shared) {
+                future = it->second.future;
+            } else {
+                future = promise.get_future().share();
+                id = ++lastId;
+                calls.emplace(key, Call{id, future});
+            }
+        }
+        if (shared) {
+            sharedCalls++;
+            return future.get();
+        }
+
+        try
+        {
+            // Created non-const so that take() can move it out once nobody else holds it
+            std::shared_ptr<const Result> result = std::make_shared<Result>(fn());
+            promise.set_value(result);
+            finish(key, id);
+            return result;
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+            finish(key, id);
+            throw;
+        }
+    }
+
+    // The result of run as an owned value. It is moved out if the caller holds the only
+    // reference, which is the case unless another caller joined the call, and copied otherwise.
+    static Result take(std::shared_ptr<const Result> result)
+    {
+        if (result.use_count() == 1) {
+            return std::move(const_cast<Result&>(*result));
+        }
+        return *result;
+    }
+
+    // Later calls for the key start a new call instead of joining the running one, e.g. because
+    // the data changed after the running call was sent
+    void forget(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        calls.erase(key);
+    }
+
+    // Calls answered with the result of another call
+    long long shared() const { return sharedCalls; }
+
+private:
+    typedef struct Call
+    {
+        unsigned long long id;
+        std::shared_future<std::shared_ptr<const Result>> future;
+    } Call;
+
+    void finish(const std::string& key, unsigned long long id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // The key may belong to a newer call if it was forgotten in the meantime
+        auto it = calls.find(key);
+        if (it != calls.end() && it->second.id == id) {
+            calls.erase(it);
+        }
+    }
+
+    std::mutex mutex;
+    std::map<std::string, Call> calls;
+    unsigned long long lastId = 0;
+    std::atomic<long long> sharedCalls{0};
+};
+
+#endif // SINGLEFLIGHT_H
@@ -0,0 +1,146 @@
+#include "nlohmann/json.hpp"
+#include "logging.h"
+
+#include "tokenstore.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+
+using json = nlohmann::json;
+
+static std::string sha256Hex(const std::string& value)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (!EVP_Digest(value.data(), value.size(), digest, &length, EVP_sha256(), nullptr)) {
+        throw std::runtime_error("Failed to hash client id");
+    }
+    std::ostringstream hex;
+    for (unsigned int i = 0; i < length; i++) {
+        hex << std::hex << std::setw(2) << std::setfill('0') << int(digest[i]);
+    }
+    return hex.str();
+}
+
+// Creates the directory and its missing parents, new directories are only accessible by the owner
+static bool makeDirectories(const std::string& path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0) {
+        return S_ISDIR(info.st_mode);
+    }
+    auto parent = path.find_last_of('/');
+    if (parent != std::string::npos && parent > 0 && !makeDirectories(path.substr(0, parent))) {
+        return false;
+    }
+    return mkdir(path.c_str(), 0700) == 0 || errno == EEXIST;
+}
+
+TokenStore::TokenStore(const std::string& directory)
+{
+    this->directory = directory;
+}
+
+std::string TokenStore::defaultDirectory()
+{
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    if (cacheHome != nullptr && *cacheHome != '\0') {
+        return std::string(cacheHome) + "/lopdns-api-client";
+    }
+    const char* home = getenv("HOME");
+    return std::string(home != nullptr ? home : ".") + "/.cache/lopdns-api-client";
+}
+
+std::string TokenStore::pathFor(const std::string& client_id) const
+{
+    return directory + "/token-" + sha256Hex(client_id) + ".json";
+}
+
+bool TokenStore::load(const std::string& client_id, Token& token)
+{
+    std::string path = pathFor(client_id);
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        LOG_DEBUG << "No stored token in " << path;
+        return false;
+    }
+    if (info.st_uid != getuid() || (info.st_mode & 0077) != 0) {
+        LOG_WARNING << "Ignoring stored token " << path << ", it must be owned by the user with mode 0600.";
+        return false;
+    }
+
+    try
+    {
+        std::ifstream file(path);
+        json data = json::parse(file);
+        token.token = data.at("token").get<std::string>();
+        token.expires = data.at("expires").get<std::string>();
+        token.epochExpires = data.at("epochExpires").get<long long>();
+        token.tzone = data.at("tz").get<std::string>();
+    }
+    catch (const std::exception& e)
+    {
+        LOG_WARNING << "Ignoring invalid stored token " << path << ": " << e.what();
+        return false;
+    }
+    LOG_DEBUG << "Loaded stored token from " << path;
+    return true;
+}
+
+bool TokenStore::save(const std::string& client_id, const Token& token)
+{
+    if (!makeDirectories(directory)) {
+        LOG_ERROR << "Failed to create token directory " << directory << ": " << strerror(errno);
+        return false;
+    }
+
+    json data;
+    data["token"] = token.token;
+    data["expires"] = token.expires;
+    data["epochExpires"] = token.epochExpires;
+    data["tz"] = token.tzone;
+    std::string content = data.dump();
+
+    // Write a temporary file next to the target and rename it, readers never see a partial token
+    std::string path = pathFor(client_id);
+    std::string temporaryPath = path + ".tmp." + std::to_string(getpid());
+    // A leftover file of an earlier run with this pid keeps its mode and owner if reused, and a
+    // planted symlink would be followed, so the file is always created anew
+    if (unlink(temporaryPath.c_str()) != 0 && errno != ENOENT) {
+        LOG_ERROR << "Failed to remove stale token file " << temporaryPath << ": " << strerror(errno);
+        return false;
+    }
+    int fd = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+    if (fd < 0) {
+        LOG_ERROR << "Failed to write token file " << temporaryPath << ": " << strerror(errno);
+        return false;
+    }
+    bool written = fchmod(fd, 0600) == 0
+        && write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size())
+        && fsync(fd) == 0;
+    written = close(fd) == 0 && written;
+    if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        LOG_ERROR << "Failed to store token in " << path << ": " << strerror(errno);
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+    LOG_DEBUG << "Stored token in " << path;
+    return true;
+}
+
+bool TokenStore::remove(const std::string& client_id)
+{
+    std::string path = pathFor(client_id);
+    if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+        LOG_ERROR << "Failed to remove stored token " << path << ": " << strerror(errno);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+#ifndef TOKENSTORE_H
+#define TOKENSTORE_H
+
+#include <string>
+#include "lopdnsclient.h"
+
+// Keeps API tokens between process invocations. Every client id gets its own file, named
+// after the SHA-256 of the client id so the id itself is never written to disk. Files are
+// created with mode 0600 and replaced atomically, files readable by others are ignored.
+class TokenStore
+{
+public:
+    explicit TokenStore(const std::string& directory = defaultDirectory());
+
+    // $XDG_CACHE_HOME/lopdns-api-client, or ~/.cache/lopdns-api-client
+    static std::string defaultDirectory();
+
+    bool load(const std::string& client_id, Token& token);
+    bool save(const std::string& client_id, const Token& token);
+    bool remove(const std::string& client_id);
+
+    std::string pathFor(const std::string& client_id) const;
+
+private:
+    std::string directory;
+};
+
+#endif // TOKENSTORE_H
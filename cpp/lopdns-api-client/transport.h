@@ -0,0 +1,72 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <optional>
+#include <functional>
+#include "connectionpool.h"
+
+typedef std::map<std::string, std::string> Headers;
+
+typedef struct Response
+{
+    int code;
+    // Received or moved from httplib without copying
+    std::string body;
+    Headers headers;
+
+    // The body for decoders that read it in place
+    std::string_view view() const { return body; }
+} Response;
+
+typedef std::map<std::string, std::string> QueryParams;
+
+// Takes a piece of a response body, returns false to stop receiving it
+typedef std::function<bool(const char* data, size_t length)> BodyReceiver;
+
+typedef struct TransportRequest
+{
+    std::string method;
+    // Path including the API version, e.g. /v2/zones
+    std::string uri;
+    Headers headers;
+    QueryParams queryParams;
+    std::string body;
+    std::string contentType;
+    // If set, the decoded body of a 2xx response is passed here piece by piece as it arrives
+    // instead of being collected in Response::body. When the receiver stops, the response is
+    // returned with its status and the rest of the body is dropped.
+    BodyReceiver bodyReceiver;
+} TransportRequest;
+
+typedef struct TransportResult
+{
+    // Code -1 and the error text as body if the request could not be sent
+    Response response;
+    // Labels the timing metrics, a new connection includes the TCP connect and TLS handshake
+    bool reusedConnection = false;
+    double connectionWaitSeconds = 0.0;
+    // Time until the response headers arrived, if the backend can tell
+    std::optional<double> firstByteSeconds;
+    // Size of the body as received, smaller than the decoded body if it was compressed. -1 if
+    // the backend does not know.
+    long long wireBytes = -1;
+} TransportResult;
+
+// Sends the requests of a LopDnsClient. Implementations must be safe to call from several
+// threads at the same time.
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+
+    virtual TransportResult send(const TransportRequest& request) = 0;
+    // Base URL the requests go to, only used for logging
+    virtual std::string describe() const = 0;
+    // Connection reuse counters, zero for backends without connections
+    virtual ConnectionPoolStats getConnectionPoolStats() { return ConnectionPoolStats(); }
+};
+
+#endif // TRANSPORT_H
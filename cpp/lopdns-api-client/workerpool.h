@@ -0,0 +1,104 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <vector>
+#include <algorithm>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <type_traits>
+#include <atomic>
+#include <stdexcept>
+
+// A fixed number of threads executing submitted tasks in submission order
+class WorkerPool
+{
+public:
+    explicit WorkerPool(int threadCount);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    template <typename Fn>
+    auto submit(Fn fn) -> std::future<decltype(fn())>
+    {
+        typedef decltype(fn()) ResultType;
+        auto task = std::make_shared<std::packaged_task<ResultType()>>(std::move(fn));
+        std::future<ResultType> result = task->get_future();
+        enqueue([task]() { (*task)(); });
+        return result;
+    }
+
+    int size() const { return int(threads.size()); }
+
+private:
+    void enqueue(std::function<void()> task);
+    void run();
+
+    std::vector<std::thread> threads;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    bool stopping = false;
+};
+
+// Shared cancellation flag, copies refer to the same flag. Work that has not started yet checks
+// it and gives up, work that is already running is not interrupted.
+class CancellationToken
+{
+public:
+    CancellationToken() : cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() { cancelled->store(true); }
+    bool isCancelled() const { return cancelled->load(); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled;
+};
+
+class OperationCancelled : public std::runtime_error
+{
+public:
+    OperationCancelled() : std::runtime_error("operation cancelled") {}
+};
+
+// Calls fn for every item using at most `concurrency` threads. The results are
+// returned in the order of the items, regardless of the order of completion.
+// Exceptions thrown by fn are rethrown for the first failing item.
+template <typename Container, typename Fn>
+auto parallelMap(const Container& items, int concurrency, Fn fn)
+    -> std::vector<typename std::decay<decltype(fn(*items.begin()))>::type>
+{
+    typedef typename std::decay<decltype(fn(*items.begin()))>::type ResultType;
+    std::vector<ResultType> results;
+    results.reserve(items.size());
+
+    int threadCount = std::min<int>(concurrency, int(items.size()));
+    if (threadCount <= 1) {
+        for (const auto& item : items) {
+            results.push_back(fn(item));
+        }
+        return results;
+    }
+
+    WorkerPool pool(threadCount);
+    std::vector<std::future<ResultType>> futures;
+    futures.reserve(items.size());
+    for (const auto& item : items) {
+        futures.push_back(pool.submit([&fn, &item]() { return fn(item); }));
+    }
+    for (auto& future : futures) {
+        future.wait();
+    }
+    for (auto& future : futures) {
+        results.push_back(future.get());
+    }
+    return results;
+}
+
+#endif // WORKERPOOL_H
@@ -0,0 +1,357 @@
+#include "logging.h"
+
+#include "zonefile.h"
+#include <set>
+#include <cctype>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+
+// Record types whose content ends with a domain name
+static const std::set<std::string> nameTargetTypes = {"CNAME", "DNAME", "NS", "PTR", "MX", "SRV"};
+
+// Record types with a priority in front of the content
+static bool hasPriority(const std::string& type)
+{
+    return type == "MX" || type == "SRV";
+}
+
+static bool isTextType(const std::string& type)
+{
+    return type == "TXT" || type == "SPF";
+}
+
+static std::string toUpper(std::string value)
+{
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::toupper(c); });
+    return value;
+}
+
+// Implementation for ZoneFileWriter
+
+ZoneFileWriter::ZoneFileWriter(std::ostream& output, const std::string& zone)
+    : output(output)
+{
+    this->zone = zone;
+}
+
+void ZoneFileWriter::writeHeader()
+{
+    output << "; Zone " << zone << ", exported by lopdns-api-client\n";
+    output << "$ORIGIN " << zone << ".\n";
+}
+
+std::string ZoneFileWriter::ownerName(const std::string& name) const
+{
+    if (name == zone) {
+        return "@";
+    }
+    if (name.size() > zone.size() + 1 && name.compare(name.size() - zone.size(), zone.size(), zone) == 0
+        && name[name.size() - zone.size() - 1] == '.') {
+        return name.substr(0, name.size() - zone.size() - 1);
+    }
+    return name + ".";
+}
+
+// Quotes text in strings of at most 255 bytes, content that is quoted already is kept
+static void writeText(std::ostream& output, const std::string& content)
+{
+    if (content.size() >= 2 && content.front() == '"' && content.back() == '"') {
+        output << content;
+        return;
+    }
+    size_t chunkStart = 0;
+    do {
+        std::string chunk = content.substr(chunkStart, 255);
+        if (chunkStart > 0) {
+            output << ' ';
+        }
+        output << '"';
+        for (unsigned char c : chunk) {
+            if (c == '"' || c == '\\') {
+                output << '\\' << c;
+            } else if (c < 0x20 || c >= 0x7f) {
+                char escaped[5];
+                snprintf(escaped, sizeof(escaped), "\\%03u", unsigned(c));
+                output << escaped;
+            } else {
+                output << c;
+            }
+        }
+        output << '"';
+        chunkStart += 255;
+    } while (chunkStart < content.size());
+}
+
+void ZoneFileWriter::write(const Record& record)
+{
+    output << ownerName(record.name) << '\t' << record.ttl << "\tIN\t" << record.type << '\t';
+    if (hasPriority(record.type)) {
+        output << record.priority << ' ';
+    }
+    if (isTextType(record.type)) {
+        writeText(output, record.content);
+    } else if (nameTargetTypes.count(record.type) && !record.content.empty() && record.content.back() != '.') {
+        output << record.content << '.';
+    } else {
+        output << record.content;
+    }
+    output << '\n';
+    count++;
+}
+
+// Implementation for ZoneFileReader
+
+ZoneFileReader::ZoneFileReader(std::istream& input, const std::string& zone, int defaultTtl)
+    : input(input)
+{
+    this->origin = zone;
+    this->defaultTtl = defaultTtl;
+}
+
+void ZoneFileReader::fail(const std::string& message) const
+{
+    throw std::runtime_error("zone file line " + std::to_string(lineNumber) + ": " + message);
+}
+
+// Quoted tokens start with a '"' that is not part of the value
+static bool isQuoted(const std::string& token)
+{
+    return !token.empty() && token[0] == '"';
+}
+
+static std::string unquote(const std::string& token)
+{
+    return isQuoted(token) ? token.substr(1) : token;
+}
+
+// TTL in seconds or with BIND units, e.g. 3600, 1h or 1h30m
+static bool parseTtl(const std::string& token, int& ttl)
+{
+    if (token.empty() || !std::isdigit(static_cast<unsigned char>(token[0]))) {
+        return false;
+    }
+    long long total = 0;
+    long long value = 0;
+    bool pendingValue = false;
+    for (char c : token) {
+        if (std::isdigit(static_cast<unsigned char>(c))) {
+            value = value * 10 + (c - '0');
+            pendingValue = true;
+            if (value > INT32_MAX) {
+                return false;
+            }
+            continue;
+        }
+        long long unit = 0;
+        switch (std::tolower(static_cast<unsigned char>(c))) {
+            case 's': unit = 1; break;
+            case 'm': unit = 60; break;
+            case 'h': unit = 3600; break;
+            case 'd': unit = 86400; break;
+            case 'w': unit = 604800; break;
+            default: return false;
+        }
+        if (!pendingValue) {
+            return false;
+        }
+        total += value * unit;
+        value = 0;
+        pendingValue = false;
+    }
+    total += value;
+    if (total > INT32_MAX) {
+        return false;
+    }
+    ttl = int(total);
+    return true;
+}
+
+static bool isClass(const std::string& token)
+{
+    std::string upper = toUpper(token);
+    return upper == "IN" || upper == "CH" || upper == "HS" || upper == "CS";
+}
+
+std::string ZoneFileReader::absoluteName(const std::string& name) const
+{
+    if (name == "@") {
+        return origin;
+    }
+    if (!name.empty() && name.back() == '.') {
+        return name.substr(0, name.size() - 1);
+    }
+    return origin.empty() ? name : name + "." + origin;
+}
+
+// Splits the next entry into tokens, joining the lines of parentheses and dropping comments
+bool ZoneFileReader::readEntry(std::vector<std::string>& tokens, bool& ownerOmitted)
+{
+    tokens.clear();
+    int depth = 0;
+    std::string line;
+    while (std::getline(input, line)) {
+        lineNumber++;
+        if (tokens.empty() && depth == 0) {
+            recordLine = lineNumber;
+            ownerOmitted = !line.empty() && (line[0] == ' ' || line[0] == '\t');
+        }
+        size_t i = 0;
+        while (i < line.size()) {
+            char c = line[i];
+            if (c == ';') {
+                break;
+            }
+            if (c == ' ' || c == '\t' || c == '\r') {
+                i++;
+                continue;
+            }
+            if (c == '(') {
+                depth++;
+                i++;
+                continue;
+            }
+            if (c == ')') {
+                if (depth == 0) {
+                    fail("unbalanced ')'");
+                }
+                depth--;
+                i++;
+                continue;
+            }
+
+            std::string token;
+            if (c == '"') {
+                token = "\"";
+                bool closed = false;
+                for (i++; i < line.size(); i++) {
+                    if (line[i] == '"') {
+                        closed = true;
+                        i++;
+                        break;
+                    }
+                    if (line[i] == '\\' && i + 1 < line.size()) {
+                        // \DDD is a decimal byte value, any other escaped character stands for itself
+                        if (i + 3 < line.size() && std::isdigit(static_cast<unsigned char>(line[i + 1]))
+                            && std::isdigit(static_cast<unsigned char>(line[i + 2]))
+                            && std::isdigit(static_cast<unsigned char>(line[i + 3]))) {
+                            token += char(std::stoi(line.substr(i + 1, 3)));
+                            i += 3;
+                        } else {
+                            token += line[++i];
+                        }
+                        continue;
+                    }
+                    token += line[i];
+                }
+                if (!closed) {
+                    fail("unterminated quoted string");
+                }
+            } else {
+                while (i < line.size() && std::strchr(" \t\r;()\"", line[i]) == nullptr) {
+                    token += line[i++];
+                }
+            }
+            tokens.push_back(token);
+        }
+        if (depth == 0 && !tokens.empty()) {
+            return true;
+        }
+    }
+    if (depth > 0) {
+        fail("unbalanced '('");
+    }
+    return false;
+}
+
+bool ZoneFileReader::next(Record& record)
+{
+    std::vector<std::string> tokens;
+    bool ownerOmitted = false;
+    while (readEntry(tokens, ownerOmitted)) {
+        if (!ownerOmitted && tokens[0][0] == '$') {
+            std::string directive = toUpper(tokens[0]);
+            if (tokens.size() < 2) {
+                fail(directive + " without a value");
+            }
+            if (directive == "$ORIGIN") {
+                origin = absoluteName(tokens[1]);
+            } else if (directive == "$TTL") {
+                if (!parseTtl(tokens[1], defaultTtl)) {
+                    fail("invalid TTL '" + tokens[1] + "'");
+                }
+            } else {
+                fail("unsupported directive " + directive);
+            }
+            continue;
+        }
+
+        size_t position = 0;
+        if (ownerOmitted) {
+            if (previousOwner.empty()) {
+                fail("record without owner name");
+            }
+        } else {
+            previousOwner = absoluteName(tokens[position++]);
+        }
+
+        // TTL and class are optional and may come in either order
+        int ttl = defaultTtl;
+        for (int i = 0; i < 2 && position < tokens.size(); i++) {
+            if (isClass(tokens[position])) {
+                if (toUpper(tokens[position]) != "IN") {
+                    fail("unsupported class " + tokens[position]);
+                }
+                position++;
+            } else if (parseTtl(tokens[position], ttl)) {
+                position++;
+            }
+        }
+        if (position >= tokens.size()) {
+            fail("missing record type");
+        }
+        std::string type = toUpper(tokens[position++]);
+        std::vector<std::string> data(tokens.begin() + position, tokens.end());
+        if (data.empty()) {
+            fail("missing data of " + type + " record");
+        }
+        if (type == "SOA") {
+            LOG_DEBUG << "Skipping SOA record on line " << recordLine << ".";
+            continue;
+        }
+
+        record.name = previousOwner;
+        record.type = type;
+        record.ttl = ttl;
+        record.priority = 0;
+        if (hasPriority(type)) {
+            try
+            {
+                record.priority = std::stoi(data.front());
+            }
+            catch (const std::exception&)
+            {
+                fail("invalid priority '" + data.front() + "'");
+            }
+            data.erase(data.begin());
+            if (data.empty()) {
+                fail("missing target of " + type + " record");
+            }
+        }
+        if (nameTargetTypes.count(type)) {
+            data.back() = absoluteName(data.back());
+        }
+
+        record.content.clear();
+        for (const auto& token : data) {
+            // The strings of a TXT record form one text, other data is separated by spaces
+            if (!record.content.empty() && !isTextType(type)) {
+                record.content += ' ';
+            }
+            record.content += unquote(token);
+        }
+        return true;
+    }
+    return false;
+}
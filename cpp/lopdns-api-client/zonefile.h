@@ -0,0 +1,57 @@
+#ifndef ZONEFILE_H
+#define ZONEFILE_H
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include "lopdnsclient.h"
+
+// Writes records as an RFC 1035 master file, one line per record as it is passed in.
+// Record names are written relative to the zone, targets of CNAME, MX, NS, PTR and SRV
+// records absolute. The priority of MX and SRV records is written in front of the content.
+class ZoneFileWriter
+{
+public:
+    ZoneFileWriter(std::ostream& output, const std::string& zone);
+
+    void writeHeader();
+    void write(const Record& record);
+
+    size_t written() const { return count; }
+
+private:
+    std::string ownerName(const std::string& name) const;
+
+    std::ostream& output;
+    std::string zone;
+    size_t count = 0;
+};
+
+// Reads an RFC 1035 master file one record at a time. Supports $ORIGIN and $TTL, relative and
+// '@' owner names, blank owners, TTL units, parentheses and quoted strings. SOA records are
+// skipped, the API manages them. Errors throw std::runtime_error with the line number.
+class ZoneFileReader
+{
+public:
+    ZoneFileReader(std::istream& input, const std::string& zone, int defaultTtl = 3600);
+
+    // Reads the next record, false at the end of the file
+    bool next(Record& record);
+    // Line of the file the last record started on
+    size_t line() const { return recordLine; }
+
+private:
+    bool readEntry(std::vector<std::string>& tokens, bool& ownerOmitted);
+    std::string absoluteName(const std::string& name) const;
+    [[noreturn]] void fail(const std::string& message) const;
+
+    std::istream& input;
+    std::string origin;
+    std::string previousOwner;
+    int defaultTtl;
+    size_t lineNumber = 0;
+    size_t recordLine = 0;
+};
+
+#endif // ZONEFILE_H
@@ -0,0 +1,138 @@
+#include "zoneindex.h"
+#include <algorithm>
+
+static void addSlot(std::vector<size_t>& bucket, size_t slot)
+{
+    bucket.insert(std::lower_bound(bucket.begin(), bucket.end(), slot), slot);
+}
+
+static void removeSlot(std::unordered_map<std::string, std::vector<size_t>>& index, const std::string& key, size_t slot)
+{
+    auto it = index.find(key);
+    if (it == index.end()) {
+        return;
+    }
+    auto& bucket = it->second;
+    auto position = std::lower_bound(bucket.begin(), bucket.end(), slot);
+    if (position != bucket.end() && *position == slot) {
+        bucket.erase(position);
+    }
+    if (bucket.empty()) {
+        index.erase(it);
+    }
+}
+
+ZoneIndex::ZoneIndex(const std::vector<Record>& records)
+{
+    assign(records);
+}
+
+void ZoneIndex::assign(const std::vector<Record>& records)
+{
+    slots = records;
+    used.assign(records.size(), true);
+    byNameType.clear();
+    byNameType.reserve(records.size());
+    for (size_t slot = 0; slot < slots.size(); slot++) {
+        indexSlot(slot);
+    }
+    count = records.size();
+}
+
+std::string ZoneIndex::nameTypeKey(const std::string& name, const std::string& type)
+{
+    std::string key;
+    key.reserve(name.size() + type.size() + 1);
+    key.append(name).append(1, '\0').append(type);
+    return key;
+}
+
+void ZoneIndex::indexSlot(size_t slot)
+{
+    const Record& record = slots[slot];
+    addSlot(byNameType[nameTypeKey(record.name, record.type)], slot);
+}
+
+void ZoneIndex::unindexSlot(size_t slot)
+{
+    const Record& record = slots[slot];
+    removeSlot(byNameType, nameTypeKey(record.name, record.type), slot);
+}
+
+long ZoneIndex::findSlot(const std::string& name, const std::string& type, const std::string& content) const
+{
+    auto it = byNameType.find(nameTypeKey(name, type));
+    if (it == byNameType.end()) {
+        return -1;
+    }
+    for (size_t slot : it->second) {
+        if (slots[slot].content == content) {
+            return static_cast<long>(slot);
+        }
+    }
+    return -1;
+}
+
+std::vector<Record> ZoneIndex::find(const std::string& name, const std::string& type) const
+{
+    std::vector<Record> result;
+    auto it = byNameType.find(nameTypeKey(name, type));
+    if (it != byNameType.end()) {
+        result.reserve(it->second.size());
+        for (size_t slot : it->second) {
+            result.push_back(slots[slot]);
+        }
+    }
+    return result;
+}
+
+const Record* ZoneIndex::find(const std::string& name, const std::string& type, const std::string& content) const
+{
+    long slot = findSlot(name, type, content);
+    return slot < 0 ? nullptr : &slots[slot];
+}
+
+void ZoneIndex::insert(const Record& record)
+{
+    slots.push_back(record);
+    used.push_back(true);
+    indexSlot(slots.size() - 1);
+    count++;
+}
+
+bool ZoneIndex::update(const std::string& oldName, const std::string& oldType, const std::string& oldContent, const Record& record)
+{
+    long slot = findSlot(oldName, oldType, oldContent);
+    if (slot < 0) {
+        return false;
+    }
+    unindexSlot(slot);
+    slots[slot] = record;
+    indexSlot(slot);
+    return true;
+}
+
+bool ZoneIndex::erase(const std::string& name, const std::string& type, const std::string& content)
+{
+    long slot = findSlot(name, type, content);
+    if (slot < 0) {
+        return false;
+    }
+    unindexSlot(slot);
+    used[slot] = false;
+    slots[slot] = Record{};
+    count--;
+    return true;
+}
+
+std::vector<Record> ZoneIndex::records() const
+{
+    std::vector<Record> result;
+    result.reserve(count);
+    for (size_t slot = 0; slot < slots.size(); slot++) {
+        if (used[slot]) {
+            result.push_back(slots[slot]);
+        }
+    }
+    return result;
+}
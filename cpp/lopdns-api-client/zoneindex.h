@@ -0,0 +1,49 @@
+#ifndef ZONEINDEX_H
+#define ZONEINDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "lopdnsclient.h"
+
+// The records of a zone, hash-indexed by (name, type). Lookups only touch the
+// records with the requested key and return them in zone order. Records created, updated or
+// deleted after the zone was fetched are applied incrementally, the zone is not indexed again.
+class ZoneIndex
+{
+public:
+    ZoneIndex() = default;
+    explicit ZoneIndex(const std::vector<Record>& records);
+
+    void assign(const std::vector<Record>& records);
+
+    // Records with the name and type
+    std::vector<Record> find(const std::string& name, const std::string& type) const;
+    // The first record with the name, type and content, nullptr if there is none
+    const Record* find(const std::string& name, const std::string& type, const std::string& content) const;
+
+    void insert(const Record& record);
+    // Replaces the first record with the old name, type and content, returns false if there is none
+    bool update(const std::string& oldName, const std::string& oldType, const std::string& oldContent, const Record& record);
+    // Removes the first record with the name, type and content, returns false if there is none
+    bool erase(const std::string& name, const std::string& type, const std::string& content);
+
+    // All records in zone order
+    std::vector<Record> records() const;
+    size_t size() const { return count; }
+
+private:
+    static std::string nameTypeKey(const std::string& name, const std::string& type);
+    long findSlot(const std::string& name, const std::string& type, const std::string& content) const;
+    void indexSlot(size_t slot);
+    void unindexSlot(size_t slot);
+
+    // Records stay in their slot so that the slot order is the zone order, erased slots are only unmarked
+    std::vector<Record> slots;
+    std::vector<bool> used;
+    // Slot numbers in ascending order
+    std::unordered_map<std::string, std::vector<size_t>> byNameType;
+    size_t count = 0;
+};
+
+#endif // ZONEINDEX_H
@@ -0,0 +1,265 @@
+#include "logging.h"
+
+#include "zonesnapshot.h"
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char snapshotMagic[8] = {'L', 'O', 'P', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t snapshotByteOrder = 0x01020304;
+
+static_assert(sizeof(SnapshotHeader) % 8 == 0 && sizeof(SnapshotZone) % 8 == 0 && sizeof(SnapshotString) % 8 == 0,
+              "snapshot sections must stay 8-byte aligned");
+static_assert(sizeof(SnapshotRecord) == 32, "snapshot records are fixed width");
+
+// Collects the strings of a snapshot, equal strings are stored once
+class StringTable
+{
+public:
+    SnapshotString add(const std::string& value)
+    {
+        auto it = offsets.find(value);
+        if (it != offsets.end()) {
+            return it->second;
+        }
+        if (blob.size() + value.size() > UINT32_MAX) {
+            throw std::runtime_error("snapshot string table exceeds 4 GiB");
+        }
+        SnapshotString ref{uint32_t(blob.size()), uint32_t(value.size())};
+        blob.append(value);
+        offsets.emplace(value, ref);
+        return ref;
+    }
+
+    const std::string& data() const { return blob; }
+
+private:
+    std::string blob;
+    std::unordered_map<std::string, SnapshotString> offsets;
+};
+
+static bool writeAll(int fd, const void* buffer, size_t length)
+{
+    const char* position = static_cast<const char*>(buffer);
+    while (length > 0) {
+        ssize_t written = write(fd, position, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        position += written;
+        length -= size_t(written);
+    }
+    return true;
+}
+
+bool writeZoneSnapshot(const std::string& path, const std::vector<std::string>& zones,
+                       const std::vector<std::vector<Record>>& zoneRecords)
+{
+    std::vector<size_t> order(zones.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&zones](size_t a, size_t b) { return zones[a] < zones[b]; });
+
+    StringTable strings;
+    std::vector<SnapshotString> types;
+    std::unordered_map<std::string, uint16_t> typeIds;
+    std::vector<SnapshotZone> zoneTable;
+    std::vector<SnapshotRecord> recordTable;
+    zoneTable.reserve(zones.size());
+    try
+    {
+        for (size_t zone : order) {
+            SnapshotZone entry;
+            entry.name = strings.add(zones[zone]);
+            entry.firstRecord = uint32_t(recordTable.size());
+            entry.recordCount = uint32_t(zoneRecords[zone].size());
+            zoneTable.push_back(entry);
+            for (const auto& record : zoneRecords[zone]) {
+                auto typeId = typeIds.find(record.type);
+                if (typeId == typeIds.end()) {
+                    if (types.size() > UINT16_MAX) {
+                        throw std::runtime_error("too many record types");
+                    }
+                    typeId = typeIds.emplace(record.type, uint16_t(types.size())).first;
+                    types.push_back(strings.add(record.type));
+                }
+                SnapshotRecord entry = {};
+                entry.name = strings.add(record.name);
+                entry.content = strings.add(record.content);
+                entry.ttl = record.ttl;
+                entry.priority = record.priority;
+                entry.typeId = typeId->second;
+                recordTable.push_back(entry);
+            }
+        }
+    }
+    catch (const std::runtime_error& e)
+    {
+        LOG_ERROR << "Failed to build snapshot " << path << ": " << e.what();
+        return false;
+    }
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+    header.version = snapshotVersion;
+    header.byteOrder = snapshotByteOrder;
+    header.zoneCount = uint32_t(zoneTable.size());
+    header.typeCount = uint32_t(types.size());
+    header.recordCount = uint32_t(recordTable.size());
+    header.createdAt = int64_t(std::time(nullptr));
+    header.zonesOffset = sizeof(SnapshotHeader);
+    header.typesOffset = header.zonesOffset + zoneTable.size() * sizeof(SnapshotZone);
+    header.recordsOffset = header.typesOffset + types.size() * sizeof(SnapshotString);
+    header.stringsOffset = header.recordsOffset + recordTable.size() * sizeof(SnapshotRecord);
+    header.stringsSize = strings.data().size();
+
+    // Write a temporary file next to the target and rename it, mapped readers keep the old file
+    std::string temporaryPath = path + ".tmp." + std::to_string(getpid());
+    int fd = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG_ERROR << "Failed to write snapshot " << temporaryPath << ": " << strerror(errno);
+        return false;
+    }
+    bool written = writeAll(fd, &header, sizeof(header))
+        && writeAll(fd, zoneTable.data(), zoneTable.size() * sizeof(SnapshotZone))
+        && writeAll(fd, types.data(), types.size() * sizeof(SnapshotString))
+        && writeAll(fd, recordTable.data(), recordTable.size() * sizeof(SnapshotRecord))
+        && writeAll(fd, strings.data().data(), strings.data().size())
+        && fsync(fd) == 0;
+    written = close(fd) == 0 && written;
+    if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        LOG_ERROR << "Failed to write snapshot " << path << ": " << strerror(errno);
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+    LOG_DEBUG << "Wrote snapshot of " << zoneTable.size() << " zones and " << recordTable.size()
+              << " records to " << path;
+    return true;
+}
+
+// Implementation for ZoneSnapshot
+
+static bool sectionFits(uint64_t offset, uint64_t count, uint64_t entrySize, uint64_t fileSize)
+{
+    return offset <= fileSize && count <= (fileSize - offset) / entrySize;
+}
+
+ZoneSnapshot::ZoneSnapshot(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open snapshot " + path + ": " + strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(SnapshotHeader)) {
+        close(fd);
+        throw std::runtime_error("invalid snapshot " + path + ": file too short");
+    }
+    size = size_t(info.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("failed to map snapshot " + path + ": " + strerror(errno));
+    }
+    data = static_cast<const char*>(mapping);
+    header = reinterpret_cast<const SnapshotHeader*>(data);
+
+    std::string error;
+    if (std::memcmp(header->magic, snapshotMagic, sizeof(header->magic)) != 0) {
+        error = "not a snapshot file";
+    } else if (header->version != snapshotVersion) {
+        error = "unsupported version " + std::to_string(header->version);
+    } else if (header->byteOrder != snapshotByteOrder) {
+        error = "written on a host with another byte order";
+    } else if (header->zonesOffset % 8 || header->typesOffset % 8 || header->recordsOffset % 8
+               || !sectionFits(header->zonesOffset, header->zoneCount, sizeof(SnapshotZone), size)
+               || !sectionFits(header->typesOffset, header->typeCount, sizeof(SnapshotString), size)
+               || !sectionFits(header->recordsOffset, header->recordCount, sizeof(SnapshotRecord), size)
+               || !sectionFits(header->stringsOffset, header->stringsSize, 1, size)) {
+        error = "sections out of bounds";
+    }
+    if (!error.empty()) {
+        munmap(const_cast<char*>(data), size);
+        throw std::runtime_error("invalid snapshot " + path + ": " + error);
+    }
+    zones = reinterpret_cast<const SnapshotZone*>(data + header->zonesOffset);
+    types = reinterpret_cast<const SnapshotString*>(data + header->typesOffset);
+    recordTable = reinterpret_cast<const SnapshotRecord*>(data + header->recordsOffset);
+    strings = data + header->stringsOffset;
+}
+
+ZoneSnapshot::~ZoneSnapshot()
+{
+    munmap(const_cast<char*>(data), size);
+}
+
+std::string_view ZoneSnapshot::stringAt(const SnapshotString& ref) const
+{
+    if (uint64_t(ref.offset) + ref.length > header->stringsSize) {
+        throw std::runtime_error("invalid snapshot: string out of bounds");
+    }
+    return std::string_view(strings + ref.offset, ref.length);
+}
+
+std::string_view ZoneSnapshot::zoneName(size_t zone) const
+{
+    return stringAt(zones[zone].name);
+}
+
+std::optional<size_t> ZoneSnapshot::findZone(std::string_view name) const
+{
+    size_t low = 0;
+    size_t high = zoneCount();
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        std::string_view candidate = zoneName(middle);
+        if (candidate == name) {
+            return middle;
+        }
+        if (candidate < name) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return std::nullopt;
+}
+
+size_t ZoneSnapshot::recordCount(size_t zone) const
+{
+    const SnapshotZone& entry = zones[zone];
+    if (uint64_t(entry.firstRecord) + entry.recordCount > header->recordCount) {
+        throw std::runtime_error("invalid snapshot: records of zone out of bounds");
+    }
+    return entry.recordCount;
+}
+
+SnapshotRecordView ZoneSnapshot::record(size_t zone, size_t index) const
+{
+    const SnapshotRecord& entry = recordTable[zones[zone].firstRecord + index];
+    if (entry.typeId >= header->typeCount) {
+        throw std::runtime_error("invalid snapshot: unknown record type");
+    }
+    return SnapshotRecordView{stringAt(entry.name), stringAt(types[entry.typeId]), stringAt(entry.content),
+                              entry.ttl, entry.priority};
+}
+
+std::vector<Record> ZoneSnapshot::records(size_t zone) const
+{
+    std::vector<Record> result;
+    result.reserve(recordCount(zone));
+    forEachRecord(zone, [&result](const SnapshotRecordView& view) {
+        result.push_back(Record{std::string(view.name), std::string(view.type), std::string(view.content),
+                                view.ttl, view.priority});
+    });
+    return result;
+}
@@ -0,0 +1,125 @@
+#ifndef ZONESNAPSHOT_H
+#define ZONESNAPSHOT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include "lopdnsclient.h"
+
+// Binary snapshot of the records of one or more zones, read through mmap without parsing.
+//
+// Layout, all integers in host byte order and every section 8-byte aligned:
+//   SnapshotHeader
+//   SnapshotZone[zoneCount]      sorted by zone name
+//   SnapshotString[typeCount]    record types, referenced by SnapshotRecord::typeId
+//   SnapshotRecord[recordCount]  the records of each zone are contiguous
+//   strings                      deduplicated names and contents, not NUL terminated
+//
+// Snapshots are replaced atomically, processes that have one mapped keep reading the old file.
+
+constexpr uint32_t snapshotVersion = 1;
+
+typedef struct SnapshotString
+{
+    uint32_t offset;
+    uint32_t length;
+} SnapshotString;
+
+typedef struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    // 0x01020304 as written, a file from a host with another byte order is rejected
+    uint32_t byteOrder;
+    uint32_t zoneCount;
+    uint32_t typeCount;
+    uint32_t recordCount;
+    uint32_t reserved;
+    int64_t createdAt;
+    uint64_t zonesOffset;
+    uint64_t typesOffset;
+    uint64_t recordsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+} SnapshotHeader;
+
+typedef struct SnapshotZone
+{
+    SnapshotString name;
+    uint32_t firstRecord;
+    uint32_t recordCount;
+} SnapshotZone;
+
+typedef struct SnapshotRecord
+{
+    SnapshotString name;
+    SnapshotString content;
+    int32_t ttl;
+    int32_t priority;
+    uint16_t typeId;
+    uint16_t reserved;
+    uint32_t reserved2;
+} SnapshotRecord;
+
+// A record of a mapped snapshot, the views point into the mapping
+typedef struct SnapshotRecordView
+{
+    std::string_view name;
+    std::string_view type;
+    std::string_view content;
+    int ttl;
+    int priority;
+} SnapshotRecordView;
+
+// Writes the records of the zones to path, replacing the file atomically
+bool writeZoneSnapshot(const std::string& path, const std::vector<std::string>& zones,
+                       const std::vector<std::vector<Record>>& zoneRecords);
+
+// A read-only mapping of a snapshot file. The constructor only checks the header and the
+// section bounds, string references are checked when a record is read. Invalid files throw
+// std::runtime_error.
+class ZoneSnapshot
+{
+public:
+    explicit ZoneSnapshot(const std::string& path);
+    ~ZoneSnapshot();
+
+    ZoneSnapshot(const ZoneSnapshot&) = delete;
+    ZoneSnapshot& operator=(const ZoneSnapshot&) = delete;
+
+    size_t zoneCount() const { return header->zoneCount; }
+    std::string_view zoneName(size_t zone) const;
+    // Binary search over the sorted zone table
+    std::optional<size_t> findZone(std::string_view name) const;
+    size_t recordCount(size_t zone) const;
+    SnapshotRecordView record(size_t zone, size_t index) const;
+    // Unix time the snapshot was written
+    long long createdAt() const { return header->createdAt; }
+
+    template <typename Fn>
+    void forEachRecord(size_t zone, Fn fn) const
+    {
+        size_t count = recordCount(zone);
+        for (size_t i = 0; i < count; i++) {
+            fn(record(zone, i));
+        }
+    }
+
+    // Copies the records of a zone, e.g. for computeChangeSet
+    std::vector<Record> records(size_t zone) const;
+
+private:
+    std::string_view stringAt(const SnapshotString& ref) const;
+
+    const char* data = nullptr;
+    size_t size = 0;
+    const SnapshotHeader* header = nullptr;
+    const SnapshotZone* zones = nullptr;
+    const SnapshotString* types = nullptr;
+    const SnapshotRecord* recordTable = nullptr;
+    const char* strings = nullptr;
+};
+
+#endif // ZONESNAPSHOT_H